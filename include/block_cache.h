@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace stbe {
+
+// A capacity-bounded LRU cache of decoded file blocks, split into shards with
+// a lock each. It can be shared by any number of Decoders, on any files, to
+// put all their hot blocks under one memory budget. Usage is bounded by the
+// total capacity, whatever the size of blocks: a shard evicts its least
+// recently used blocks first, then others' if that is not enough.
+class BlockCache {
+public:
+  // Keeps a block alive while held, even after the cache evicted it.
+  using Handle = std::shared_ptr<const std::string>;
+
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    size_t usage = 0;  // bytes of blocks currently in the cache
+  };
+
+  // capacity: total bytes of blocks to keep in 2^num_shard_bits shards.
+  explicit BlockCache(size_t capacity, int num_shard_bits = 4);
+
+  BlockCache(const BlockCache&) = delete;
+  void operator=(const BlockCache&) = delete;
+
+  // Returns a unique id to tell the blocks of one file from another's. Ids
+  // are given per FileHandle, so only readers sharing a FileHandle share its
+  // blocks, two FileHandles on the same file do not.
+  static uint64_t newFileId();
+
+  // Returns nullptr if the block is not cached.
+  Handle lookup(uint64_t file_id, uint64_t offset);
+  // Adds a block, replacing any block cached under the same key, and evicts
+  // blocks to stay within capacity. A block larger than capacity is not kept.
+  Handle insert(uint64_t file_id, uint64_t offset, std::string block);
+
+  size_t capacity() const {
+    return capacity_;
+  }
+  Stats stats() const;
+
+private:
+  struct Key {
+    uint64_t file_id;
+    uint64_t offset;
+    bool operator==(const Key& other) const {
+      return file_id == other.file_id && offset == other.offset;
+    }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& key) const;
+  };
+
+  struct Shard {
+    mutable std::mutex mutex;
+    size_t usage = 0;
+    // most recently used in front.
+    std::list<std::pair<Key, Handle>> lru;
+    std::unordered_map<Key, std::list<std::pair<Key, Handle>>::iterator, KeyHash> map;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+  };
+
+  Shard& shardFor(const Key& key) {
+    return shards_[KeyHash()(key) & shard_mask_];
+  }
+
+  // Evicts the least recently used blocks of shard until usage_ is within
+  // capacity_ or shard is down to its keep most recent ones, shard.mutex is
+  // held.
+  void evict(Shard& shard, size_t keep);
+
+  const size_t capacity_;
+  const size_t shard_mask_;
+  std::vector<Shard> shards_;
+  std::atomic<size_t> usage_{0};  // of all shards
+};
+
+}  // namespace stbe
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+namespace stbe {
+
+// Codec ids, stored in block headers. Ids from kFirstUserCodec on are left
+// to codecs registered by applications.
+constexpr uint8_t kNoCompression = 0;
+constexpr uint8_t kLZCompression = 1;  // see util/lz.h
+constexpr uint8_t kFirstUserCodec = 128;
+
+// Compresses blocks as they are written and uncompresses them as they are
+// read. Must be thread safe.
+class Codec {
+public:
+  virtual ~Codec() = default;
+
+  virtual uint8_t id() const = 0;
+  virtual const char* name() const = 0;
+  // Appends the compressed form of input[0,n-1] to output. Returns false if
+  // the block is better stored uncompressed.
+  virtual bool compress(const char* input, size_t n, std::string* output) const = 0;
+  // Stores the uncompressed block to output, returns false if input is
+  // corrupt.
+  virtual bool uncompress(const char* input, size_t n, std::string* output) const = 0;
+};
+
+// Returns the codec registered with id, nullptr if there is none.
+const Codec* getCodec(uint8_t id);
+
+// Makes codec available to Builders and FileHandles under codec->id(). The
+// codec must outlive them. Returns false if the id is already taken.
+bool registerCodec(const Codec* codec);
+
+}  // namespace stbe
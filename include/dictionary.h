@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace stbe {
+
+// A trie of values shared by all data blocks of a file, for fields with few
+// distinct values (hosts, methods, status paths...). Blocks refer to its
+// nodes instead of storing those values again, see Builder::setDictionary().
+// It is immutable once built, so encoders on any thread can share it.
+class Dictionary {
+public:
+  // Builds the trie of values, duplicates are dropped.
+  explicit Dictionary(const std::vector<std::string>& values);
+
+  Dictionary(const Dictionary&) = delete;
+  void operator=(const Dictionary&) = delete;
+
+  // The serialized trie as stored in the file: <Fixed32 0><trie nodes>, laid
+  // out like a data block without records, so the root is at position 4.
+  const std::string& data() const {
+    return data_;
+  }
+  size_t numValues() const {
+    return positions_.size();
+  }
+  // Position of the node of value in data(), 0 if it is not in the
+  // dictionary.
+  uint32_t find(const std::string& value) const {
+    auto it = positions_.find(value);
+    return it == positions_.end() ? 0 : it->second;
+  }
+
+  // Picks the values of samples worth a dictionary: those seen at least
+  // twice, up to max_values of the most frequent ones.
+  static std::vector<std::string> selectValues(const std::vector<std::string>& samples,
+                                               size_t max_values);
+
+private:
+  std::string data_;
+  std::unordered_map<std::string, uint32_t> positions_;
+};
+
+}  // namespace stbe
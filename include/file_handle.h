@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "block_cache.h"
+#include "format.h"
+#include "predicate.h"
+#include "util/mmap_file.h"
+
+namespace stbe {
+
+// When to check block checksums (format version 3 and later).
+enum ChecksumPolicy {
+  kVerifyNever,
+  // every time a block is read from the file or the mapping.
+  kVerifyAlways,
+  // whenever a block is read from the file, but not again when it is served
+  // from the block cache or from mapped pages verified before.
+  kVerifyOnFirstLoad,
+};
+
+struct DecoderOptions {
+  // Map the file into memory instead of reading blocks with pread().
+  // Blocks are then decoded straight from the mapping, without copies.
+  bool use_mmap = false;
+  // madvise hints for the mapping, e.g. kSequential for scans and kRandom
+  // for lookups. Only used with use_mmap.
+  MmapFile::Options mmap;
+  // Data blocks read with pread() are kept in this cache, which can be
+  // shared with other files. Blocks are cached per FileHandle: Cursors on
+  // one FileHandle share them, FileHandles opened on the same file do not.
+  // Not used with use_mmap, mapped blocks are decoded in place anyway.
+  std::shared_ptr<BlockCache> block_cache;
+  ChecksumPolicy verify_checksums = kVerifyOnFirstLoad;
+};
+
+// An open STBE file: the parsed index block plus a way to read data blocks.
+// It is immutable once constructed, so one FileHandle can be shared by any
+// number of threads, each reading through its own Cursor.
+class FileHandle {
+public:
+  struct BlockInfo {
+    uint64_t offset;
+    uint32_t num_records;
+    uint64_t accumlated_records;
+    // field summaries of the block in summaries_.
+    size_t summaries_offset = 0;
+    uint32_t summaries_size = 0;
+  };
+
+  // Summary of a string field of a data block, see
+  // Builder::enableFieldSummaries(). filter is empty without a bloom filter.
+  struct FieldSummary {
+    std::string_view min;
+    std::string_view max;
+    std::string_view filter;
+  };
+
+  // The contents of a data block. data points into buf, into the mapping, or
+  // into a block pinned by handle, whichever the block was read into.
+  struct Block {
+    const char* data = nullptr;
+    size_t size = 0;
+    std::string buf;
+    BlockCache::Handle handle;
+  };
+
+  explicit FileHandle(const std::string& fname,
+                      const DecoderOptions& options = DecoderOptions());
+  ~FileHandle();
+
+  FileHandle(const FileHandle&) = delete;
+  void operator=(const FileHandle&) = delete;
+
+  size_t numBlocks() const {
+    return blocks_info_.size();
+  }
+  const BlockInfo& blockInfo(uint32_t index) const {
+    return blocks_info_[index];
+  }
+  uint32_t formatVersion() const {
+    return format_version_;
+  }
+  uint64_t totalRecords() const {
+    if (blocks_info_.empty()) {
+      return 0;
+    }
+    return blocks_info_.back().accumlated_records;
+  }
+
+  // locate the block number by record_index, returns numBlocks() if
+  // record_index is out of range.
+  uint32_t locateBlock(uint64_t record_index) const {
+    if (blocks_info_.empty()) return 0;
+    return locateBlock(record_index, 0, blocks_info_.size() - 1);
+  }
+
+  // Returns false if data block index has no summary of string field field.
+  bool fieldSummary(uint32_t index, uint32_t field, FieldSummary* summary) const;
+  // Returns false if data block index certainly holds no record whose string
+  // field field matches predicate, judging by the index block alone.
+  bool blockMayMatch(uint32_t index, uint32_t field, const StringPredicate& predicate) const;
+
+  // The serialized Dictionary the file was built with, empty if none. It is
+  // loaded with the index block and stays resident, see
+  // BlockDecoder::setDictionary().
+  std::string_view dictionary() const {
+    return std::string_view(dictionary_.data, dictionary_.size);
+  }
+
+  // Reads data block index into block. Safe to call from several threads,
+  // as long as each passes its own block.
+  bool readDataBlock(uint32_t index, Block* block) const;
+  // Hints that data block index is read soon. On a mapped file the kernel
+  // starts paging it in (MADV_WILLNEED), otherwise it does nothing.
+  void prefetchDataBlock(uint32_t index) const;
+
+private:
+  int fd_ = -1;
+  MmapFile mmap_;
+  std::shared_ptr<BlockCache> block_cache_;
+  uint64_t file_id_ = 0;  // key of this file in block_cache_
+  const ChecksumPolicy verify_checksums_;
+  // set once a mapped data block passed verification.
+  std::unique_ptr<std::atomic<bool>[]> verified_;
+  uint32_t format_version_ = 0;
+  uint64_t index_block_offset_ = 0;
+  // where the data blocks end: the dictionary block if any, else the index
+  // block.
+  uint64_t data_end_offset_ = 0;
+  uint64_t footer_offset_ = 0;
+  std::vector<BlockInfo> blocks_info_;
+  std::string summaries_;  // field summaries of all blocks
+  Block dictionary_;
+
+  // Parses the last footer_len bytes of a file of file_size bytes.
+  bool parseFooter(const char* footer, size_t footer_len, uint64_t file_size);
+  bool loadBlockIndex();
+  // Reads the block at [offset, limit), limit being the start of whatever
+  // follows it in the file.
+  bool readBlock(uint64_t offset, uint64_t limit, bool verify, Block* block) const;
+  uint32_t locateBlock(uint64_t record_index, uint32_t begin, uint32_t end) const;
+};
+
+}  // namespace stbe
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace stbe {
+
+// File layout:
+//   [<block header><data block>]...
+//   <block header><index block>
+//   <footer>
+//
+// The block header is <block length Fixed32> up to version 2. Version 3
+// appends <masked crc32c of the block Fixed32> to it. Version 4 appends
+// <codec id byte> (see compression.h), the block is stored in the form the
+// codec produced and the crc32c covers the block and the codec id.
+//
+// Version 1 (no magic): the index block holds
+//   <# of blocks varint32>[<block offset varint32, # of records varint32>]
+// and the footer is just <index block offset Fixed32>.
+//
+// Version 2 and later: the index block holds
+//   <# of blocks varint64>[<block offset varint64, # of records varint32>]
+// Version 5 appends <field summaries length varint32><field summaries> to
+// every block entry, empty unless the file was built with them (see
+// BlockEncoder::buildFieldSummaries()). Version 6 appends
+//   <has dictionary byte>[<dictionary block offset varint64>]
+// after the block entries, the dictionary block (see dictionary.h) being
+// written right before the index block. The footer is
+//   <index block offset Fixed64><format version Fixed32><magic Fixed64>
+constexpr uint32_t kFormatVersion1 = 1;
+constexpr uint32_t kFormatVersion2 = 2;
+constexpr uint32_t kFormatVersion3 = 3;
+constexpr uint32_t kFormatVersion4 = 4;
+constexpr uint32_t kFormatVersion5 = 5;
+constexpr uint32_t kFormatVersion6 = 6;
+constexpr uint32_t kLatestFormatVersion = kFormatVersion6;
+
+inline size_t blockHeaderSize(uint32_t format_version) {
+  if (format_version >= kFormatVersion4) return 2 * sizeof(uint32_t) + 1;
+  return format_version >= kFormatVersion3 ? 2 * sizeof(uint32_t) : sizeof(uint32_t);
+}
+
+constexpr uint64_t kFooterMagic = 0x454C494645425453ull;  // "STBEFILE"
+constexpr size_t kFooterSize = sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint64_t);
+constexpr size_t kFooterSizeV1 = sizeof(uint32_t);
+
+}  // namespace stbe
@@ -1,15 +1,57 @@
 #pragma once
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
+#include "dictionary.h"
+#include "predicate.h"
+#include "util/arena.h"
+#include "util/bloom.h"
 #include "util/coding.h"
 #include "trie.h"
 
 namespace stbe {
 
+// Records between two restart points of a block, 0 disables restart points.
+constexpr uint32_t kDefaultRestartInterval = 16;
+// Set in the records offset of a block header when the block ends with a
+// restart trailer: [<restart offset>...]<# of restarts><restart interval>,
+// all Fixed32.
+constexpr uint32_t kBlockHasRestarts = 0x80000000u;
+// Set in the records offset of a block header when trie nodes carry child
+// lists, see TrieNode::serialize(). BlockDecoder::findExact() and
+// findPrefix() need them.
+constexpr uint32_t kBlockHasChildIndex = 0x40000000u;
+// Set in the records offset of a block header when records are stored by
+// column, see BlockEncoder::setColumnar(). Records are then
+//   <# of records varint32><# of columns varint32>[<column size varint32>]
+// followed by the columns, the i-th holding the i-th varint of every record.
+// Columnar blocks have no restart points.
+constexpr uint32_t kBlockColumnar = 0x20000000u;
+// Set in the records offset of a block header when every string field has a
+// trie of its own, see BlockEncoder::setFieldTries(). The tries follow each
+// other and the records offset points to
+//   <# of tries varint32>[<root position Fixed32>...]
+// with records right after it.
+constexpr uint32_t kBlockFieldTries = 0x10000000u;
+// Set in the records offset of a block header when string fields may refer
+// to nodes of the file's Dictionary. Such references are stored as the end of
+// the block's tries plus the node position in Dictionary::data().
+constexpr uint32_t kBlockSharedDictionary = 0x08000000u;
+constexpr uint32_t kBlockFlags = kBlockHasRestarts | kBlockHasChildIndex |
+    kBlockColumnar | kBlockFieldTries | kBlockSharedDictionary;
+// The records offset takes the bits below the flags, so the tries of a block
+// must stay under 128MB.
+constexpr uint32_t kMaxRecordsOffset = 1u << 27;
+static_assert(((kMaxRecordsOffset - 1) & kBlockFlags) == 0,
+              "records offsets overlap the block flags");
+
 class TrieValueEncoder {
 public:
   virtual void addString2Trie(const std::string& value) = 0;
@@ -20,6 +62,14 @@ public:
 class TrieValueDecoder {
 public:
   virtual bool decodeString(std::string& value) = 0;
+  // Decodes a string without allocating once scratch has grown large enough.
+  // value points either into scratch or into the decoder's own buffer, and is
+  // valid until scratch is modified or the decoder moves to another block.
+  virtual bool decodeStringView(std::string& scratch, std::string_view& value) {
+    if (!decodeString(scratch)) return false;
+    value = scratch;
+    return true;
+  }
   virtual bool decodeUint32(uint32_t& value) = 0;
   virtual bool skipString() = 0;
   virtual bool skipUint32() = 0;
@@ -29,24 +79,42 @@ public:
 template <typename RecordType>
 class recordMarshaller;
 
-// Specialized marshaller for RecordType == std::string.
+// # of varints in every record of a marshaller that declares it as
+// `static constexpr uint32_t kNumVarints`, 0 for those that do not.
+// BlockDecoder::go() skips records of fixed size with SkipVarints() instead
+// of skip(), and BlockDecoder::nextRecordsRaw() decodes them in batches.
+template <typename Marshaller, typename = void>
+struct marshallerVarints : std::integral_constant<uint32_t, 0> {};
+template <typename Marshaller>
+struct marshallerVarints<Marshaller, std::void_t<decltype(Marshaller::kNumVarints)>>
+    : std::integral_constant<uint32_t, Marshaller::kNumVarints> {};
+
+// Specialized marshaller for RecordType == std::string. The functions are
+// templates so BlockEncoder and BlockDecoder call themselves without virtual
+// dispatch, hand-written marshallers may take TrieValueEncoder& and
+// TrieValueDecoder& instead. See schema.h for records with several fields.
 template <>
 class recordMarshaller<std::string> {
 public:
+  static constexpr uint32_t kNumVarints = 1;
   static float avgSize() {
     return kAvgVarintSize;
   }
-  static void add2Trie(TrieValueEncoder& trie_encoder, const std::string& record) {
+  template <typename TrieEncoder>
+  static void add2Trie(TrieEncoder& trie_encoder, const std::string& record) {
     trie_encoder.addString2Trie(record);
   }
-  static void encode(TrieValueEncoder& trie_encoder, const std::string& record) {
+  template <typename TrieEncoder>
+  static void encode(TrieEncoder& trie_encoder, const std::string& record) {
     trie_encoder.encodeString(0);
   }
 
-  static bool decode(TrieValueDecoder& trie_decoder, std::string& record) {
+  template <typename TrieDecoder>
+  static bool decode(TrieDecoder& trie_decoder, std::string& record) {
     return trie_decoder.decodeString(record);
   }
-  static bool skip(TrieValueDecoder& trie_decoder) {
+  template <typename TrieDecoder>
+  static bool skip(TrieDecoder& trie_decoder) {
     return trie_decoder.skipString();
   }
 };
@@ -56,58 +124,312 @@ public:
 template <typename T, typename RecordEncoder = recordMarshaller<T> >
 class BlockEncoder : public TrieValueEncoder {
 private:
-  Trie trie_;
+  Trie trie_;  // of all string fields, or the first with field tries
+  // Tries of the other string fields, see setFieldTries().
+  bool field_tries_ = false;
+  std::vector<std::unique_ptr<Trie>> more_tries_;
   std::vector<T> records_;
-  std::vector<std::vector<TriePosition>> positions_;
-  std::vector<TriePosition>* cur_positions_ = nullptr;  // points to current position vector during serialization
+  // A string field value: a node of the block's tries, or with shared set,
+  // of dictionary_.
+  struct ValueRef {
+    TriePosition node;
+    uint32_t shared;  // node position in the dictionary, 0 if none
+  };
+  std::vector<std::vector<ValueRef>> positions_;
+  std::vector<ValueRef>* cur_positions_ = nullptr;  // points to current position vector during serialization
+  // Streaming, see setStreaming(). Records are encoded as they are added
+  // into pending_, string fields as ids of their nodes in nodes_ (1 based),
+  // every varint64 tagged by its kind in the low 2 bits.
+  enum PendingKind { kPendingValue = 0, kPendingNode = 1, kPendingShared = 2 };
+  bool streaming_ = false;
+  std::string pending_;
+  std::vector<uint32_t> record_ends_;  // offsets in pending_
+  std::vector<TriePosition> nodes_;
+  std::vector<ValueRef> cur_refs_;  // of the record being added
+  std::shared_ptr<const Dictionary> dictionary_;
+  uint32_t shared_base_ = 0;  // where the tries end, see kBlockSharedDictionary
   std::string buf_;  // temporary buffer for serialization
-  
+  uint32_t restart_interval_;
+  std::vector<uint32_t> restarts_;  // record offsets of restart points
+  bool child_index_ = false;
+  // Per string field summaries, see setFieldSummaries().
+  struct FieldStats {
+    std::string min;
+    std::string max;
+    std::vector<uint32_t> hashes;  // BloomHash() of the values
+  };
+  bool field_summaries_ = false;
+  int bits_per_key_ = 0;
+  std::vector<FieldStats> field_stats_;
+  uint32_t field_ = 0;  // string field of the record being added
+  // Columnar layout, see setColumnar(). column_ is the column of the next
+  // varint of the record being encoded.
+  bool columnar_ = false;
+  std::vector<std::string> columns_;
+  uint32_t column_ = 0;
+
 public:
-  BlockEncoder() {}
+  explicit BlockEncoder(uint32_t restart_interval = kDefaultRestartInterval)
+      : restart_interval_(restart_interval) {}
+
+  // Serialize child lists along with the trie, for top-down lookups.
+  void setChildIndex(bool enabled) {
+    child_index_ = enabled;
+  }
+
+  // Store every field in a column of its own instead of record after record,
+  // so decoders read only the fields they project, see
+  // BlockDecoder::setProjection(). Fields are the varints of a record in the
+  // order the marshaller encodes them, every record must encode as many.
+  void setColumnar(bool enabled) {
+    columnar_ = enabled;
+  }
+
+  // Give every string field a trie of its own instead of sharing one, so
+  // unrelated values do not crowd the same nodes and each field's nodes stay
+  // together in the block.
+  void setFieldTries(bool enabled) {
+    field_tries_ = enabled;
+  }
+
+  // Refer to the nodes of dictionary for the values it holds instead of
+  // adding them to the block's tries. Decoders need the same dictionary, see
+  // BlockDecoder::setDictionary().
+  void setDictionary(std::shared_ptr<const Dictionary> dictionary) {
+    dictionary_ = std::move(dictionary);
+  }
+
+  // Encode records as they are added instead of keeping copies of them
+  // until serialize(). String fields are stored as compact ids of their trie
+  // nodes, which are swapped for node positions once the tries are
+  // serialized. Memory then grows with the encoded records rather than with
+  // the records themselves. The block is the same either way. Call before
+  // the first add().
+  void setStreaming(bool enabled) {
+    streaming_ = enabled;
+  }
+
+  // Keep min/max and, with bits_per_key > 0, a bloom filter of every string
+  // field, see buildFieldSummaries().
+  void setFieldSummaries(bool enabled, int bits_per_key) {
+    field_summaries_ = enabled;
+    bits_per_key_ = bits_per_key;
+  }
+  // Appends <# of fields varint32> followed by
+  // [<min><max><bloom filter>], each prefixed with its varint32 length, for
+  // every string field of the records added so far.
+  void buildFieldSummaries(std::string* dst) const;
 
   // TrieValueEncoder functions.
-  void addString2Trie(const std::string& value) override {
-    positions_.back().emplace_back(trie_.add(value));
+  void addString2Trie(const std::string& value) final {
+    uint32_t shared = dictionary_ != nullptr ? dictionary_->find(value) : 0;
+    cur_positions_->push_back(
+        ValueRef{shared != 0 ? TriePosition() : fieldTrie().add(value), shared});
+    if (field_summaries_) addFieldValue(value);
+    ++field_;
   }
-  void encodeString(size_t index) override {
-    PutVarint32(&buf_, cur_positions_->at(index).getPosition());
+  void encodeString(size_t index) final {
+    ValueRef ref = cur_positions_->at(index);
+    if (streaming_) {
+      if (ref.shared != 0) {
+        putPending(kPendingShared, ref.shared);
+        return;
+      }
+      if (ref.node.getId() == 0) {
+        nodes_.push_back(ref.node);
+        ref.node.setId(nodes_.size());
+      }
+      putPending(kPendingNode, ref.node.getId());
+      return;
+    }
+    PutVarint32(output(), ref.shared != 0 ? shared_base_ + ref.shared
+                                          : ref.node.getPosition());
   }
-  void encodeUint32(uint32_t value) override {
-    PutVarint32(&buf_, value);
+  void encodeUint32(uint32_t value) final {
+    if (streaming_) {
+      putPending(kPendingValue, value);
+      return;
+    }
+    PutVarint32(output(), value);
   }
 
   void add(T record) {
+    field_ = 0;
+    if (streaming_) {
+      cur_refs_.clear();
+      cur_positions_ = &cur_refs_;
+      RecordEncoder::add2Trie(*this, record);
+      RecordEncoder::encode(*this, record);
+      record_ends_.push_back(pending_.size());
+      return;
+    }
     records_.emplace_back(std::move(record));
     positions_.emplace_back();
+    cur_positions_ = &positions_.back();
     RecordEncoder::add2Trie(*this, records_.back());
   }
 
+  // Returns an empty string if the tries of the block reach kMaxRecordsOffset.
   const std::string& serialize();
 
   size_t numRecords() {
-    return records_.size();
+    return streaming_ ? record_ends_.size() : records_.size();
   }
 
   size_t estimatedSize() {
-    return trie_.estimatedSize() +
-        static_cast<size_t>(records_.size() * RecordEncoder::avgSize());
+    size_t size = trie_.estimatedSize();
+    size_t num_nodes = trie_.numNodes();
+    for (auto& trie : more_tries_) {
+      size += trie->estimatedSize();
+      num_nodes += trie->numNodes();
+    }
+    // The child index stores a count byte and a Fixed32 offset per node.
+    if (child_index_) size += num_nodes * (1 + sizeof(uint32_t));
+    return size +
+        static_cast<size_t>(numRecords() * RecordEncoder::avgSize());
   }
 
   void clear() {
     trie_.clear();
+    for (auto& trie : more_tries_) trie->clear();
     records_.clear();
     positions_.clear();
+    pending_.clear();
+    record_ends_.clear();
+    nodes_.clear();
+    field_stats_.clear();
+  }
+
+private:
+  void putPending(PendingKind kind, uint32_t value) {
+    PutVarint64(&pending_, static_cast<uint64_t>(value) << 2 | kind);
+  }
+  // Encodes the i-th record added, to output().
+  void encodeRecord(size_t i);
+  Trie& fieldTrie() {
+    if (!field_tries_ || field_ == 0) return trie_;
+    while (more_tries_.size() < field_) more_tries_.emplace_back(new Trie());
+    return *more_tries_[field_ - 1];
+  }
+  // Where the next varint of a record goes.
+  std::string* output() {
+    if (!columnar_) return &buf_;
+    if (column_ == columns_.size()) columns_.emplace_back();
+    return &columns_[column_++];
+  }
+  void addFieldValue(const std::string& value) {
+    if (field_ == field_stats_.size()) {
+      field_stats_.push_back(FieldStats{value, value, {}});
+    }
+    FieldStats& stats = field_stats_[field_];
+    if (value < stats.min) stats.min = value;
+    if (value > stats.max) stats.max = value;
+    if (bits_per_key_ > 0) stats.hashes.push_back(BloomHash(value.data(), value.size()));
   }
 };
 
 template <typename T, typename RecordDecoder = recordMarshaller<T> >
 class BlockDecoder : public TrieValueDecoder {
+public:
+  struct MemoStats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+  };
+
 private:
   const char* buf_ = nullptr;
   const char* limit_ = nullptr;
   const char* record_ptr_ = nullptr;
   uint32_t records_offset_ = 0;
   uint32_t current_ind_ = 0;
+  // Restart trailer, restarts_ is nullptr if the block has none.
+  const char* restarts_ = nullptr;
+  uint32_t num_restarts_ = 0;
+  uint32_t restart_interval_ = 0;
+  bool has_child_index_ = false;
+  // Root positions of the tries of the block, followed by where the last
+  // one ends.
+  std::vector<uint32_t> trie_bounds_;
+  // The file's dictionary, see setDictionary(), and whether the block
+  // refers to it.
+  const char* shared_ = nullptr;
+  const char* shared_limit_ = nullptr;
+  bool has_shared_ = false;
+
+  // Columnar blocks, see BlockEncoder::setColumnar(). Each column is read
+  // lazily up to the record being decoded, current_ind_, so columns left
+  // out of projection_ (all are in when empty) are never touched.
+  struct Column {
+    const char* begin;
+    const char* limit;
+    const char* ptr;
+    uint32_t ind;  // record at ptr
+    uint32_t last;  // value of record ind - 1
+  };
+  bool columnar_ = false;
+  uint32_t num_records_ = 0;
+  std::vector<Column> columns_;
+  uint32_t column_ = 0;  // column of the next field of the current record
+  std::vector<bool> projection_;
+
+  // Set by scan() while skipping a record: the node position of the string
+  // field probe_skip_ (counting down) is stored to probe_.
+  uint32_t* probe_ = nullptr;
+  uint32_t probe_skip_ = 0;
+
+  // Memo of decoded strings by node position, only used when enabled. Values
+  // point into the block or into memo_arena_, both live until reset().
+  bool memo_enabled_ = false;
+  std::unordered_map<uint32_t, std::string_view> memo_;
+  Arena memo_arena_;
+  MemoStats memo_stats_;
+
+  void clearMemo() {
+    memo_.clear();
+    memo_arena_.Reset();
+  }
+
+  bool hasNext() const {
+    if (columnar_) return current_ind_ < num_records_;
+    return record_ptr_ != nullptr && record_ptr_ < limit_;
+  }
+  bool parseTries(bool field_tries);
+  bool parseColumns();
+  // Moves column to record ind.
+  bool seekColumn(Column& column, uint32_t ind);
+  // Reads field k of the current record from its column.
+  bool readColumn(uint32_t k, uint32_t& value);
+  bool projected(uint32_t k) const {
+    return projection_.empty() || (k < projection_.size() && projection_[k]);
+  }
+
+  // Reads the trie node at node_pos, returns a pointer just past it or
+  // nullptr on error.
+  const char* readNode(const char* base, const char* limit, uint32_t node_pos,
+                       uint32_t* parent_pos, uint32_t* len) const;
+  // Points base and limit at the nodes node_pos refers to, the block's or
+  // the dictionary's, and makes node_pos relative to base.
+  bool resolveNode(uint32_t* node_pos, const char** base, const char** limit) const;
+  // Reconstructs the value of the trie node at node_pos.
+  bool decodeNode(uint32_t node_pos, std::string& scratch, std::string_view& value) const;
+  // decodeNode() for chains too deep for its fixed piece stack.
+  bool decodeDeepNode(uint32_t node_pos, std::string& scratch, std::string_view& value) const;
+  // A node to visit in a top-down walk: its position, the end of its
+  // subtree and the bytes of the key matched by its ancestors.
+  struct NodeVisit {
+    uint32_t pos;
+    uint32_t end;
+    size_t matched;
+  };
+  // Reads the child list following a node's value at ptr, children are
+  // checked to lie in (node_pos, end).
+  const char* readChildren(const char* ptr, uint32_t node_pos, uint32_t end,
+                           uint32_t* num_children) const;
+  // findExact() and findPrefix() in the trie rooted at root, ending at end.
+  bool findExact(std::string_view value, uint32_t root, uint32_t trie_end,
+                 std::vector<uint32_t>* positions) const;
+  bool findPrefix(std::string_view prefix, uint32_t root, uint32_t trie_end,
+                  std::vector<std::pair<uint32_t, uint32_t>>* ranges) const;
 
 public:
   explicit BlockDecoder(const std::string& buf);
@@ -115,26 +437,100 @@ public:
   BlockDecoder();
 
   // TrieValueDecoder functions.
-  bool decodeString(std::string& value) override;
-  bool decodeUint32(uint32_t& value) override {
+  bool decodeString(std::string& value) final;
+  bool decodeStringView(std::string& scratch, std::string_view& value) final;
+  bool decodeUint32(uint32_t& value) final {
+    if (columnar_) {
+      uint32_t k = column_++;
+      if (projected(k)) return readColumn(k, value);
+      value = 0;
+      return k < columns_.size();
+    }
     if (record_ptr_ == nullptr || record_ptr_ >= limit_) return false;
     record_ptr_ = GetVarint32Ptr(record_ptr_, limit_, &value);
     return record_ptr_ != nullptr;
   }
-  bool skipUint32() override {
+  bool skipUint32() final {
+    if (columnar_) return column_++ < columns_.size();
     uint32_t dummy;
     return decodeUint32(dummy);
   }
-  bool skipString() override {
+  bool skipString() final {
+    if (probe_ != nullptr && probe_skip_-- == 0) {
+      bool ok = columnar_ ? readColumn(column_++, *probe_) : decodeUint32(*probe_);
+      probe_ = nullptr;
+      return ok;
+    }
     return skipUint32();
   }
 
   bool reset(const char* buf, size_t len);
 
+  // Remember every string decoded from the current block, so repeated values
+  // cost a single hash lookup. The memo is dropped by reset().
+  void setMemo(bool enabled) {
+    memo_enabled_ = enabled;
+    clearMemo();
+  }
+  const MemoStats& memoStats() const {
+    return memo_stats_;
+  }
+
+  // Decode only the given fields of columnar blocks, counted as in
+  // BlockEncoder::setColumnar(), the others are left empty or 0. An empty
+  // projection decodes all fields. Blocks stored record after record always
+  // decode all fields.
+  void setProjection(const std::vector<uint32_t>& fields) {
+    projection_.clear();
+    for (uint32_t k : fields) {
+      if (k >= projection_.size()) projection_.resize(k + 1);
+      projection_[k] = true;
+    }
+  }
+  bool isColumnar() const {
+    return columnar_;
+  }
+
+  // Top-down lookups by value, false if the block has no child index (see
+  // BlockEncoder::setChildIndex()) or is corrupt. Compare them with the node
+  // positions records refer to.
+  bool hasChildIndex() const {
+    return has_child_index_;
+  }
+  // Nodes of the Dictionary the file was built with, blocks built with it
+  // cannot be decoded without. data must outlive the decoder. Values found
+  // in it are not searched by findExact() and findPrefix().
+  void setDictionary(const char* data, size_t size) {
+    shared_ = size > 0 ? data : nullptr;
+    shared_limit_ = data + size;
+  }
+  // 1 unless the block has a trie per string field.
+  uint32_t numTries() const {
+    return trie_bounds_.empty() ? 0 : trie_bounds_.size() - 1;
+  }
+  // Appends the position of every node whose value is exactly value.
+  bool findExact(std::string_view value, std::vector<uint32_t>* positions) const;
+  // Appends [begin, end) position ranges of the subtrees holding all the
+  // nodes whose value starts with prefix.
+  bool findPrefix(std::string_view prefix,
+                  std::vector<std::pair<uint32_t, uint32_t>>* ranges) const;
+
+  // Calls callback(index, record) for the records from the current one to
+  // the end of the block whose string field field_index matches predicate.
+  // Fields are counted in the order RecordDecoder::skip() skips strings.
+  // The predicate is resolved to node positions once, with the child index
+  // if the block has one, so only matching records are decoded.
+  template <typename Callback>
+  bool scan(uint32_t field_index, const StringPredicate& predicate, Callback&& callback);
+
   // get the next record.
   bool nextRecord(T& record);
   // goto nth record, the following call to nextRecord() returns nth record.
   bool go(uint32_t ind);
+  // Decodes the next num_records records into values as they are stored,
+  // kNumVarints per record: node positions of string fields and uint32
+  // fields as is. Only for marshallers declaring kNumVarints.
+  bool nextRecordsRaw(uint32_t num_records, uint32_t* values);
 };
 
 // Templates implementation
@@ -146,13 +542,65 @@ const std::string& BlockEncoder<T, RecordEncoder>::serialize() {
   PutFixed32(&buf_, 0); 
 
   // Serialize the trie_
-  trie_.serialize(&buf_);
+  trie_.serialize(&buf_, child_index_);
   uint32_t records_offset = buf_.size();
+  std::vector<uint32_t> roots{sizeof(uint32_t)};
+  if (field_tries_) {
+    for (auto& trie : more_tries_) {
+      roots.push_back(buf_.size());
+      trie->serialize(&buf_, child_index_);
+    }
+    records_offset = buf_.size();
+  }
+  if (buf_.size() >= kMaxRecordsOffset) {
+    std::cerr << "Tries of " << buf_.size() << " bytes do not fit in a block." << std::endl;
+    buf_.clear();
+    return buf_;
+  }
+  shared_base_ = records_offset;
+  if (field_tries_) {
+    PutVarint32(&buf_, roots.size());
+    for (uint32_t root : roots) PutFixed32(&buf_, root);
+    records_offset |= kBlockFieldTries;
+  }
+  if (dictionary_ != nullptr) records_offset |= kBlockSharedDictionary;
+  if (child_index_) records_offset |= kBlockHasChildIndex;
+
+  if (columnar_) {
+    for (std::string& column : columns_) column.clear();
+    for (size_t i = 0; i < numRecords(); ++i) {
+      column_ = 0;
+      encodeRecord(i);
+    }
+    PutVarint32(&buf_, numRecords());
+    PutVarint32(&buf_, columns_.size());
+    for (const std::string& column : columns_) {
+      PutVarint32(&buf_, column.size());
+    }
+    for (const std::string& column : columns_) {
+      buf_.append(column);
+    }
+    EncodeFixed32(&buf_[0], records_offset | kBlockColumnar);
+    return buf_;
+  }
 
   // Serialize records
-  for (int i = 0; i < records_.size(); ++i) {
-    cur_positions_ = &positions_[i];
-    RecordEncoder::encode(*this, records_[i]);
+  restarts_.clear();
+  for (size_t i = 0; i < numRecords(); ++i) {
+    if (restart_interval_ > 0 && i % restart_interval_ == 0) {
+      restarts_.push_back(buf_.size());
+    }
+    encodeRecord(i);
+  }
+
+  // Write restart trailer
+  if (restart_interval_ > 0) {
+    for (uint32_t r : restarts_) {
+      PutFixed32(&buf_, r);
+    }
+    PutFixed32(&buf_, restarts_.size());
+    PutFixed32(&buf_, restart_interval_);
+    records_offset |= kBlockHasRestarts;
   }
 
   // Write records offset
@@ -162,6 +610,55 @@ const std::string& BlockEncoder<T, RecordEncoder>::serialize() {
 }
 
 
+template <typename T, typename RecordEncoder>
+void BlockEncoder<T, RecordEncoder>::encodeRecord(size_t i) {
+  if (!streaming_) {
+    cur_positions_ = &positions_[i];
+    RecordEncoder::encode(*this, records_[i]);
+    return;
+  }
+  // node positions are known now, patch them in.
+  const char* ptr = pending_.data() + (i == 0 ? 0 : record_ends_[i - 1]);
+  const char* limit = pending_.data() + record_ends_[i];
+  while (ptr < limit) {
+    uint64_t tagged;
+    ptr = GetVarint64Ptr(ptr, limit, &tagged);
+    uint32_t value = static_cast<uint32_t>(tagged >> 2);
+    switch (tagged & 3) {
+      case kPendingNode:
+        value = nodes_[value - 1].getPosition();
+        break;
+      case kPendingShared:
+        value += shared_base_;
+        break;
+    }
+    PutVarint32(output(), value);
+  }
+}
+
+template <typename T, typename RecordEncoder>
+void BlockEncoder<T, RecordEncoder>::buildFieldSummaries(std::string* dst) const {
+  PutVarint32(dst, field_stats_.size());
+  std::string filter;
+  std::vector<uint32_t> hashes;
+  for (const FieldStats& stats : field_stats_) {
+    PutVarint32(dst, stats.min.size());
+    dst->append(stats.min);
+    PutVarint32(dst, stats.max.size());
+    dst->append(stats.max);
+    filter.clear();
+    if (bits_per_key_ > 0) {
+      // values repeat a lot within a block.
+      hashes = stats.hashes;
+      std::sort(hashes.begin(), hashes.end());
+      hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+      BuildBloomFilter(hashes.data(), hashes.size(), bits_per_key_, &filter);
+    }
+    PutVarint32(dst, filter.size());
+    dst->append(filter);
+  }
+}
+
 template <typename T, typename RecordDecoder>
 BlockDecoder<T, RecordDecoder>::BlockDecoder(const char* buf, size_t len) {
   reset(buf, len);
@@ -180,35 +677,418 @@ bool BlockDecoder<T, RecordDecoder>::reset(const char* buf, size_t len) {
   buf_ = buf;
   limit_ = buf_ + len;
   records_offset_ = DecodeFixed32(buf_);
+  restarts_ = nullptr;
+  num_restarts_ = 0;
+  restart_interval_ = 0;
+  has_child_index_ = records_offset_ & kBlockHasChildIndex;
+  columnar_ = records_offset_ & kBlockColumnar;
+  const bool field_tries = records_offset_ & kBlockFieldTries;
+  has_shared_ = records_offset_ & kBlockSharedDictionary;
+  if (memo_enabled_) clearMemo();
+  const bool has_restarts = records_offset_ & kBlockHasRestarts;
+  records_offset_ &= ~kBlockFlags;
+  if (has_restarts) {
+    if (len < records_offset_ + 2 * sizeof(uint32_t)) return false;
+    restart_interval_ = DecodeFixed32(limit_ - sizeof(uint32_t));
+    num_restarts_ = DecodeFixed32(limit_ - 2 * sizeof(uint32_t));
+    if (restart_interval_ == 0 ||
+        (len - records_offset_) / sizeof(uint32_t) - 2 < num_restarts_) {
+      return false;
+    }
+    restarts_ = limit_ - (num_restarts_ + 2) * sizeof(uint32_t);
+    // records end where the trailer starts.
+    limit_ = restarts_;
+  }
+  if (records_offset_ > len || !parseTries(field_tries)) return false;
   current_ind_ = 0;
   record_ptr_ = buf_ + records_offset_;
+  return !columnar_ || parseColumns();
+}
+
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::parseTries(bool field_tries) {
+  trie_bounds_.clear();
+  if (!field_tries) {
+    trie_bounds_ = {sizeof(uint32_t), records_offset_};
+    return true;
+  }
+  uint32_t num_tries;
+  const char* ptr = GetVarint32Ptr(buf_ + records_offset_, limit_, &num_tries);
+  if (ptr == nullptr || num_tries == 0 ||
+      num_tries > static_cast<size_t>(limit_ - ptr) / sizeof(uint32_t)) {
+    return false;
+  }
+  for (uint32_t i = 0; i < num_tries; ++i) {
+    uint32_t root = DecodeFixed32(ptr + i * sizeof(uint32_t));
+    // roots are in order, the first one right after the header.
+    if (i == 0 ? root != sizeof(uint32_t) : root <= trie_bounds_.back() ||
+        root >= records_offset_) {
+      return false;
+    }
+    trie_bounds_.push_back(root);
+  }
+  trie_bounds_.push_back(records_offset_);
+  // records follow the table.
+  records_offset_ = ptr + num_tries * sizeof(uint32_t) - buf_;
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::parseColumns() {
+  uint32_t num_columns;
+  const char* ptr = GetVarint32Ptr(record_ptr_, limit_, &num_records_);
+  if (ptr == nullptr) return false;
+  ptr = GetVarint32Ptr(ptr, limit_, &num_columns);
+  if (ptr == nullptr) return false;
+  // column sizes are followed by the columns.
+  const char* data = SkipVarints(ptr, limit_, num_columns);
+  if (data == nullptr) return false;
+  columns_.resize(num_columns);
+  for (Column& column : columns_) {
+    uint32_t size;
+    ptr = GetVarint32Ptr(ptr, data, &size);
+    if (size > limit_ - data) return false;
+    column = Column{data, data + size, data, 0, 0};
+    data += size;
+  }
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::seekColumn(Column& column, uint32_t ind) {
+  if (column.ind > ind) {
+    column.ptr = column.begin;
+    column.ind = 0;
+  }
+  if (column.ind < ind) {
+    const char* ptr = SkipVarints(column.ptr, column.limit, ind - column.ind);
+    if (ptr == nullptr) return false;
+    column.ptr = ptr;
+    column.ind = ind;
+  }
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::readColumn(uint32_t k, uint32_t& value) {
+  if (k >= columns_.size()) return false;
+  Column& column = columns_[k];
+  if (column.ind == current_ind_ + 1) {
+    // read already, e.g. by scan().
+    value = column.last;
+    return true;
+  }
+  if (!seekColumn(column, current_ind_)) return false;
+  const char* ptr = GetVarint32Ptr(column.ptr, column.limit, &value);
+  if (ptr == nullptr) return false;
+  column.ptr = ptr;
+  column.last = value;
+  ++column.ind;
+  return true;
+}
+
+
+template <typename T, typename RecordDecoder>
+const char* BlockDecoder<T, RecordDecoder>::readNode(const char* base, const char* limit,
+                                                     uint32_t node_pos,
+                                                     uint32_t* parent_pos,
+                                                     uint32_t* len) const {
+  if (node_pos >= limit - base) return nullptr;
+  const char* ptr = GetVarint32Ptr(base + node_pos, limit, parent_pos);
+  if (ptr == nullptr) return nullptr;
+  ptr = GetVarint32Ptr(ptr, limit, len);
+  // parents are always serialized before their children.
+  if (ptr == nullptr || *len > limit - ptr || *parent_pos >= node_pos) {
+    return nullptr;
+  }
+  return ptr;
+}
+
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::resolveNode(uint32_t* node_pos, const char** base,
+                                                 const char** limit) const {
+  *base = buf_;
+  *limit = limit_;
+  if (!has_shared_ || *node_pos < trie_bounds_.back()) return true;
+  if (shared_ == nullptr) return false;
+  *node_pos -= trie_bounds_.back();
+  *base = shared_;
+  *limit = shared_limit_;
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::decodeNode(uint32_t node_pos,
+                                                std::string& scratch,
+                                                std::string_view& value) const {
+  // Pieces are collected from the leaf up to the root.
+  constexpr int kMaxPieces = 32;
+  std::string_view pieces[kMaxPieces];
+  int num_pieces = 0;
+  size_t total_size = 0;
+  uint32_t pos = node_pos;
+  const char* base;
+  const char* limit;
+  if (!resolveNode(&pos, &base, &limit)) return false;
+  while (pos > sizeof(uint32_t)) {  // header is a uint32_t
+    if (num_pieces == kMaxPieces) return decodeDeepNode(node_pos, scratch, value);
+    uint32_t len;
+    const char* ptr = readNode(base, limit, pos, &pos, &len);
+    if (ptr == nullptr) return false;
+    // the walk reads the empty roots of all but the first trie.
+    if (len == 0) continue;
+    pieces[num_pieces++] = std::string_view(ptr, len);
+    total_size += len;
+  }
+  if (num_pieces == 1) {
+    // a single piece is used as is, straight from the block or dictionary.
+    value = pieces[0];
+    return true;
+  }
+  scratch.resize(total_size);
+  char* dst = &scratch[0];
+  while (num_pieces > 0) {
+    const std::string_view& piece = pieces[--num_pieces];
+    memcpy(dst, piece.data(), piece.size());
+    dst += piece.size();
+  }
+  value = scratch;
   return true;
 }
 
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::decodeDeepNode(uint32_t node_pos,
+                                                    std::string& scratch,
+                                                    std::string_view& value) const {
+  // Sum up the pieces first, then fill scratch from the back while walking
+  // up the chain again.
+  size_t total_size = 0;
+  const char* base;
+  const char* limit;
+  if (!resolveNode(&node_pos, &base, &limit)) return false;
+  uint32_t pos = node_pos;
+  while (pos > sizeof(uint32_t)) {
+    uint32_t len;
+    if (readNode(base, limit, pos, &pos, &len) == nullptr) return false;
+    total_size += len;
+  }
+  scratch.resize(total_size);
+  char* dst = &scratch[0] + total_size;
+  pos = node_pos;
+  while (pos > sizeof(uint32_t)) {
+    uint32_t len;
+    const char* ptr = readNode(base, limit, pos, &pos, &len);
+    dst -= len;
+    memcpy(dst, ptr, len);
+  }
+  value = scratch;
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+const char* BlockDecoder<T, RecordDecoder>::readChildren(const char* ptr, uint32_t node_pos,
+                                                         uint32_t end,
+                                                         uint32_t* num_children) const {
+  ptr = GetVarint32Ptr(ptr, limit_, num_children);
+  if (ptr == nullptr || *num_children > (limit_ - ptr) / sizeof(uint32_t)) return nullptr;
+  uint32_t prev = node_pos;
+  for (uint32_t i = 0; i < *num_children; ++i) {
+    uint32_t child = DecodeFixed32(ptr + i * sizeof(uint32_t));
+    if (child <= prev || child >= end) return nullptr;
+    prev = child;
+  }
+  return ptr;
+}
+
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::findExact(std::string_view value,
+                                               std::vector<uint32_t>* positions) const {
+  if (!has_child_index_) return false;
+  for (size_t i = 0; i + 1 < trie_bounds_.size(); ++i) {
+    if (!findExact(value, trie_bounds_[i], trie_bounds_[i + 1], positions)) return false;
+  }
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::findExact(std::string_view value, uint32_t root,
+                                               uint32_t trie_end,
+                                               std::vector<uint32_t>* positions) const {
+  std::vector<NodeVisit> stack{{root, trie_end, 0}};
+  while (!stack.empty()) {
+    NodeVisit v = stack.back();
+    stack.pop_back();
+    uint32_t parent_pos, len;
+    const char* ptr = readNode(buf_, limit_, v.pos, &parent_pos, &len);
+    if (ptr == nullptr) return false;
+    if (len > value.size() - v.matched ||
+        memcmp(ptr, value.data() + v.matched, len) != 0) {
+      continue;
+    }
+    size_t matched = v.matched + len;
+    // the root is never a record.
+    if (matched == value.size() && v.pos != root) {
+      positions->push_back(v.pos);
+    }
+    // children sharing a first byte, or empty ones, may match too.
+    uint32_t num_children;
+    ptr = readChildren(ptr + len, v.pos, v.end, &num_children);
+    if (ptr == nullptr) return false;
+    for (uint32_t i = 0; i < num_children; ++i) {
+      uint32_t child = DecodeFixed32(ptr + i * sizeof(uint32_t));
+      uint32_t end = i + 1 < num_children
+          ? DecodeFixed32(ptr + (i + 1) * sizeof(uint32_t)) : v.end;
+      stack.push_back(NodeVisit{child, end, matched});
+    }
+  }
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::findPrefix(
+    std::string_view prefix, std::vector<std::pair<uint32_t, uint32_t>>* ranges) const {
+  if (!has_child_index_) return false;
+  size_t first = ranges->size();
+  for (size_t i = 0; i + 1 < trie_bounds_.size(); ++i) {
+    if (!findPrefix(prefix, trie_bounds_[i], trie_bounds_[i + 1], ranges)) return false;
+  }
+  std::sort(ranges->begin() + first, ranges->end());
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::findPrefix(
+    std::string_view prefix, uint32_t root, uint32_t trie_end,
+    std::vector<std::pair<uint32_t, uint32_t>>* ranges) const {
+  std::vector<NodeVisit> stack{{root, trie_end, 0}};
+  while (!stack.empty()) {
+    NodeVisit v = stack.back();
+    stack.pop_back();
+    uint32_t parent_pos, len;
+    const char* ptr = readNode(buf_, limit_, v.pos, &parent_pos, &len);
+    if (ptr == nullptr) return false;
+    size_t n = std::min<size_t>(len, prefix.size() - v.matched);
+    if (memcmp(ptr, prefix.data() + v.matched, n) != 0) continue;
+    if (n == prefix.size() - v.matched) {
+      // nodes are serialized depth first, the whole subtree has the prefix.
+      ranges->emplace_back(v.pos, v.end);
+      continue;
+    }
+    uint32_t num_children;
+    ptr = readChildren(ptr + len, v.pos, v.end, &num_children);
+    if (ptr == nullptr) return false;
+    for (uint32_t i = 0; i < num_children; ++i) {
+      uint32_t child = DecodeFixed32(ptr + i * sizeof(uint32_t));
+      uint32_t end = i + 1 < num_children
+          ? DecodeFixed32(ptr + (i + 1) * sizeof(uint32_t)) : v.end;
+      stack.push_back(NodeVisit{child, end, v.matched + len});
+    }
+  }
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+template <typename Callback>
+bool BlockDecoder<T, RecordDecoder>::scan(uint32_t field_index,
+                                          const StringPredicate& predicate,
+                                          Callback&& callback) {
+  // [begin, end) node positions of matching values, or without a child
+  // index, the verdict on every node seen.
+  std::vector<std::pair<uint32_t, uint32_t>> ranges;
+  std::unordered_map<uint32_t, bool> verdicts;
+  if (has_child_index_) {
+    // with field tries, only the trie of the field.
+    uint32_t first = 0;
+    uint32_t last = numTries();
+    if (last > 1 && field_index < last) {
+      first = field_index;
+      last = field_index + 1;
+    }
+    for (uint32_t t = first; t < last; ++t) {
+      uint32_t root = trie_bounds_[t];
+      uint32_t trie_end = trie_bounds_[t + 1];
+      if (predicate.kind == StringPredicate::kEquals) {
+        std::vector<uint32_t> positions;
+        if (!findExact(predicate.operand, root, trie_end, &positions)) return false;
+        std::sort(positions.begin(), positions.end());
+        for (uint32_t pos : positions) ranges.emplace_back(pos, pos + 1);
+      } else if (!findPrefix(predicate.operand, root, trie_end, &ranges)) {
+        return false;
+      }
+    }
+    std::sort(ranges.begin(), ranges.end());
+  }
+  std::string scratch;
+  auto matches = [&](uint32_t node_pos) {
+    if (has_child_index_ && node_pos < trie_bounds_.back()) {
+      auto it = std::upper_bound(ranges.begin(), ranges.end(),
+                                 std::make_pair(node_pos, UINT32_MAX));
+      return it != ranges.begin() && node_pos < (--it)->second;
+    }
+    auto it = verdicts.find(node_pos);
+    if (it != verdicts.end()) return it->second;
+    std::string_view value;
+    bool match = decodeNode(node_pos, scratch, value) && predicate.matches(value);
+    verdicts.emplace(node_pos, match);
+    return match;
+  };
+
+  T record{};
+  while (hasNext()) {
+    const char* record_start = record_ptr_;
+    uint32_t node_pos;
+    probe_ = &node_pos;
+    probe_skip_ = field_index;
+    column_ = 0;
+    bool ok = RecordDecoder::skip(*this);
+    // probe_ is still set if the record has no such field.
+    bool probed = probe_ == nullptr;
+    probe_ = nullptr;
+    if (!ok || record_ptr_ == nullptr) return false;
+    if (probed && matches(node_pos)) {
+      record_ptr_ = record_start;
+      if (!nextRecord(record)) return false;
+      callback(current_ind_ - 1, record);
+    } else {
+      ++current_ind_;
+    }
+  }
+  return true;
+}
 
 // TrieValueDecoder functions.
 template <typename T, typename RecordDecoder>
 bool BlockDecoder<T, RecordDecoder>::decodeString(std::string& value) {
+  std::string_view view;
+  if (!decodeStringView(value, view)) return false;
+  // view is either value itself or a piece of the block.
+  if (view.data() != value.data()) value.assign(view.data(), view.size());
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::decodeStringView(std::string& scratch,
+                                                      std::string_view& value) {
   uint32_t node_pos;
   // get the last node position from record.
   if (!decodeUint32(node_pos)) return false;
+  if (!memo_enabled_) return decodeNode(node_pos, scratch, value);
 
-  size_t total_size = 0;
-  std::vector<std::pair<const char*, uint32_t>> pieces;
-  while (node_pos > sizeof(uint32_t)) {  // header is a uint32_t
-    uint32_t len;
-    const char* ptr = GetVarint32Ptr(buf_ + node_pos, limit_, &node_pos);
-    ptr = GetVarint32Ptr(ptr, limit_, &len);
-    pieces.emplace_back(std::make_pair(ptr, len));
-    total_size += len;
+  auto it = memo_.find(node_pos);
+  if (it != memo_.end()) {
+    ++memo_stats_.hits;
+    value = it->second;
+    return true;
   }
-  value.clear();
-  value.reserve(total_size);
-  std::vector<std::pair<const char*, uint32_t>>::reverse_iterator rit = pieces.rbegin();
-  for (; rit!= pieces.rend(); ++rit) {
-    value.append(rit->first, rit->second);
+  ++memo_stats_.misses;
+  if (!decodeNode(node_pos, scratch, value)) return false;
+  if (!value.empty() && value.data() == scratch.data()) {
+    // scratch gets overwritten by the next call, keep a copy in the arena.
+    char* mem = memo_arena_.Allocate(value.size());
+    memcpy(mem, value.data(), value.size());
+    value = std::string_view(mem, value.size());
   }
-
+  memo_.emplace(node_pos, value);
   return true;
 }
 
@@ -216,8 +1096,15 @@ bool BlockDecoder<T, RecordDecoder>::decodeString(std::string& value) {
 template <typename T, typename RecordDecoder>
 bool BlockDecoder<T, RecordDecoder>::nextRecord(T& record) {
   // return false when hit the end.
-  if (record_ptr_ == nullptr || record_ptr_ >= limit_) return false;
+  if (!hasNext()) return false;
 
+  if (columnar_) {
+    // columns are read at current_ind_.
+    column_ = 0;
+    if (!RecordDecoder::decode(*this, record)) return false;
+    ++current_ind_;
+    return true;
+  }
   ++current_ind_;
   // Get start position from record_ptr_, and advance it to next record.
   if (!RecordDecoder::decode(*this, record)) return false;
@@ -230,16 +1117,74 @@ bool BlockDecoder<T, RecordDecoder>::nextRecord(T& record) {
 
 template <typename T, typename RecordDecoder>
 bool BlockDecoder<T, RecordDecoder>::go(uint32_t ind) {
+  if (columnar_) {
+    // columns catch up when read.
+    if (ind > num_records_) return false;
+    current_ind_ = ind;
+    return true;
+  }
+  if (num_restarts_ > 0) {
+    // jump to the closest restart point before ind, unless we are already
+    // between it and ind.
+    uint32_t restart = std::min(ind / restart_interval_, num_restarts_ - 1);
+    uint32_t restart_ind = restart * restart_interval_;
+    if (current_ind_ > ind || current_ind_ < restart_ind) {
+      uint32_t offset = DecodeFixed32(restarts_ + restart * sizeof(uint32_t));
+      if (offset < records_offset_ || buf_ + offset > limit_) return false;
+      current_ind_ = restart_ind;
+      record_ptr_ = buf_ + offset;
+    }
+  }
   if (current_ind_ > ind) {
     // rewind if we alrealy passed ind
     current_ind_ = 0;
     record_ptr_ = buf_ + records_offset_;
   }
-  uint32_t node_pos;
-  while (current_ind_++ < ind) {
+  constexpr uint32_t kNumVarints = marshallerVarints<RecordDecoder>::value;
+  if (kNumVarints > 0 && current_ind_ < ind && record_ptr_ != nullptr) {
+    // records are a fixed # of varints, count their ends instead.
+    record_ptr_ = SkipVarints(record_ptr_, limit_,
+                              static_cast<size_t>(ind - current_ind_) * kNumVarints);
+    if (record_ptr_ == nullptr) return false;
+    current_ind_ = ind;
+  }
+  for (; current_ind_ < ind; ++current_ind_) {
     if (record_ptr_ == nullptr || !RecordDecoder::skip(*this)) return false;
   }
   return (record_ptr_ != nullptr);
 }
 
+template <typename T, typename RecordDecoder>
+bool BlockDecoder<T, RecordDecoder>::nextRecordsRaw(uint32_t num_records, uint32_t* values) {
+  constexpr uint32_t kNumVarints = marshallerVarints<RecordDecoder>::value;
+  static_assert(kNumVarints > 0, "records must be a fixed # of varints");
+  if (columnar_) {
+    if (num_records > num_records_ - current_ind_ || columns_.size() != kNumVarints) {
+      return false;
+    }
+    std::vector<uint32_t> column_values(num_records);
+    for (uint32_t k = 0; k < kNumVarints; ++k) {
+      Column& column = columns_[k];
+      if (!seekColumn(column, current_ind_)) return false;
+      const char* ptr = GetVarint32Batch(column.ptr, column.limit,
+                                         column_values.data(), num_records);
+      if (ptr == nullptr) return false;
+      column.ptr = ptr;
+      column.ind += num_records;
+      if (num_records > 0) column.last = column_values.back();
+      for (uint32_t i = 0; i < num_records; ++i) {
+        values[i * kNumVarints + k] = column_values[i];
+      }
+    }
+    current_ind_ += num_records;
+    return true;
+  }
+  if (record_ptr_ == nullptr) return false;
+  record_ptr_ = GetVarint32Batch(record_ptr_, limit_, values,
+                                 static_cast<size_t>(num_records) * kNumVarints);
+  if (record_ptr_ == nullptr) return false;
+  current_ind_ += num_records;
+  return true;
+}
+
 }  // namespace stbe
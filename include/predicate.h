@@ -0,0 +1,30 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+namespace stbe {
+
+// A predicate on a string field, see BlockDecoder::scan() and
+// FileHandle::blockMayMatch().
+struct StringPredicate {
+  enum Kind {
+    kEquals,
+    kPrefix,
+  };
+  Kind kind;
+  std::string operand;
+
+  static StringPredicate equals(std::string value) {
+    return StringPredicate{kEquals, std::move(value)};
+  }
+  static StringPredicate prefix(std::string prefix) {
+    return StringPredicate{kPrefix, std::move(prefix)};
+  }
+  bool matches(std::string_view value) const {
+    return kind == kEquals ? value == operand
+                           : value.substr(0, operand.size()) == operand;
+  }
+};
+
+}  // namespace stbe
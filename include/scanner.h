@@ -0,0 +1,261 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#include "file_handle.h"
+#include "memblock.h"
+
+namespace stbe {
+
+// Reads the records of a FileHandle in order, from any record on. The
+// blocks following the current one are read on a background thread while
+// the current one is decoded, so a scan does not wait on I/O at every block.
+// A seek within the blocks read ahead keeps those after it. On a mapped
+// file, reading ahead asks the kernel to page the blocks in, see
+// FileHandle::prefetchDataBlock().
+//
+//   Scanner<std::string> scanner(file);
+//   for (scanner.seek(100); scanner.valid(); scanner.next()) {
+//     use(scanner.value());
+//   }
+//
+// or, from the current record to the end: for (auto& v : scanner) use(v);
+//
+// Like a Cursor, a Scanner is used by one thread at a time.
+template <typename T, typename RecordDecoder = recordMarshaller<T> >
+class Scanner {
+private:
+  struct Readahead {
+    uint32_t index;  // block number
+    bool done = false;
+    bool ok = false;
+    FileHandle::Block block;
+  };
+
+  std::shared_ptr<const FileHandle> file_;
+  BlockDecoder<T, RecordDecoder> decoder_;
+  FileHandle::Block block_;  // the block decoder_ works on
+  int64_t current_block_num_ = -1;
+  uint64_t index_ = 0;  // of value_
+  T value_{};
+  bool valid_ = false;
+
+  // Readahead, readahead_ holds the next blocks to decode in order, the
+  // io thread reads the first ones not done.
+  const uint32_t readahead_depth_;
+  std::thread io_thread_;
+  std::mutex mutex_;
+  std::condition_variable request_cv_;  // signals io_thread_ of requests
+  std::condition_variable done_cv_;  // signals of blocks read
+  std::deque<Readahead> readahead_;
+  uint64_t generation_ = 0;  // bumped whenever readahead_ is dropped
+  bool stop_ = false;
+
+  bool loadDataBlock(uint32_t index);
+  void ioLoop();
+
+public:
+  // readahead_depth: # of blocks to read ahead of the current one, 0 reads
+  // every block when it is reached.
+  explicit Scanner(std::shared_ptr<const FileHandle> file,
+                   uint32_t readahead_depth = 1);
+  ~Scanner();
+
+  Scanner(const Scanner&) = delete;
+  void operator=(const Scanner&) = delete;
+
+  // Positions at record index, not valid() if it is out of range.
+  void seek(uint64_t index);
+  void seekToFirst() {
+    seek(0);
+  }
+  bool valid() const {
+    return valid_;
+  }
+  // Moves to the next record, requires valid().
+  void next();
+  const T& value() const {
+    return value_;
+  }
+  uint64_t index() const {
+    return index_;
+  }
+  // Decode only these fields of columnar blocks, see
+  // BlockDecoder::setProjection(). Applies to the records decoded by the next
+  // next() or seek() on, value() keeps the fields it was decoded with.
+  void setProjection(const std::vector<uint32_t>& fields) {
+    decoder_.setProjection(fields);
+  }
+
+  // An input iterator over the records from the current one to the end,
+  // it advances the Scanner.
+  class iterator {
+  public:
+    using iterator_category = std::input_iterator_tag;
+    using value_type = T;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const T*;
+    using reference = const T&;
+
+    explicit iterator(Scanner* scanner = nullptr)
+        : scanner_(scanner != nullptr && scanner->valid() ? scanner : nullptr) {}
+    reference operator*() const {
+      return scanner_->value();
+    }
+    pointer operator->() const {
+      return &scanner_->value();
+    }
+    iterator& operator++() {
+      scanner_->next();
+      if (!scanner_->valid()) scanner_ = nullptr;
+      return *this;
+    }
+    bool operator==(const iterator& other) const {
+      return scanner_ == other.scanner_;
+    }
+    bool operator!=(const iterator& other) const {
+      return scanner_ != other.scanner_;
+    }
+
+  private:
+    Scanner* scanner_;
+  };
+  iterator begin() {
+    return iterator(this);
+  }
+  iterator end() {
+    return iterator();
+  }
+};
+
+// Templates implementation
+
+template <typename T, typename RecordDecoder>
+Scanner<T, RecordDecoder>::Scanner(std::shared_ptr<const FileHandle> file,
+                                   uint32_t readahead_depth)
+    : file_(std::move(file)), readahead_depth_(readahead_depth) {
+  decoder_.setDictionary(file_->dictionary().data(), file_->dictionary().size());
+  if (readahead_depth_ > 0) {
+    io_thread_ = std::thread(&Scanner::ioLoop, this);
+  }
+  seekToFirst();
+}
+
+template <typename T, typename RecordDecoder>
+Scanner<T, RecordDecoder>::~Scanner() {
+  if (!io_thread_.joinable()) return;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  request_cv_.notify_all();
+  io_thread_.join();
+}
+
+template <typename T, typename RecordDecoder>
+void Scanner<T, RecordDecoder>::ioLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    auto pending = readahead_.end();
+    request_cv_.wait(lock, [this, &pending] {
+      pending = std::find_if(readahead_.begin(), readahead_.end(),
+                             [](const Readahead& r) { return !r.done; });
+      return stop_ || pending != readahead_.end();
+    });
+    if (stop_) return;
+    uint32_t index = pending->index;
+    uint64_t generation = generation_;
+    lock.unlock();
+    FileHandle::Block block;
+    file_->prefetchDataBlock(index);
+    bool ok = file_->readDataBlock(index, &block);
+    lock.lock();
+    // the block may have been skipped by a seek meanwhile, then it is gone
+    // from readahead_, or dropped along with the whole of it.
+    if (generation != generation_) continue;
+    for (auto& r : readahead_) {
+      if (r.index == index) {
+        r.ok = ok;
+        r.block = std::move(block);
+        r.done = true;
+        break;
+      }
+    }
+    done_cv_.notify_all();
+  }
+}
+
+template <typename T, typename RecordDecoder>
+bool Scanner<T, RecordDecoder>::loadDataBlock(uint32_t index) {
+  current_block_num_ = -1;
+  bool ok;
+  if (readahead_depth_ == 0) {
+    ok = file_->readDataBlock(index, &block_);
+  } else {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto it = std::find_if(readahead_.begin(), readahead_.end(),
+                           [index](const Readahead& r) { return r.index == index; });
+    if (it != readahead_.end()) {
+      // a seek within the window skips the blocks before index, the io
+      // thread drops them if it is reading one.
+      readahead_.erase(readahead_.begin(), it);
+      done_cv_.wait(lock, [this] { return readahead_.front().done; });
+      Readahead& r = readahead_.front();
+      // data may point into buf, which moves.
+      bool in_buf = !r.block.buf.empty() && r.block.data == r.block.buf.data();
+      block_ = std::move(r.block);
+      if (in_buf) block_.data = block_.buf.data();
+      ok = r.ok;
+      readahead_.pop_front();
+    } else {
+      // a seek outside the window, drop what was read ahead.
+      readahead_.clear();
+      ++generation_;
+      lock.unlock();
+      ok = file_->readDataBlock(index, &block_);
+      lock.lock();
+    }
+    uint32_t next = readahead_.empty() ? index + 1 : readahead_.back().index + 1;
+    for (; readahead_.size() < readahead_depth_ && next < file_->numBlocks(); ++next) {
+      readahead_.emplace_back();
+      readahead_.back().index = next;
+    }
+    request_cv_.notify_one();
+  }
+  if (!ok || !decoder_.reset(block_.data, block_.size)) return false;
+  current_block_num_ = index;
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+void Scanner<T, RecordDecoder>::seek(uint64_t index) {
+  valid_ = false;
+  uint32_t block_num = file_->locateBlock(index);
+  if (block_num >= file_->numBlocks() ||
+      (block_num != current_block_num_ && !loadDataBlock(block_num))) {
+    return;
+  }
+  const FileHandle::BlockInfo& info = file_->blockInfo(block_num);
+  if (!decoder_.go(index - (info.accumlated_records - info.num_records))) return;
+  index_ = index;
+  valid_ = decoder_.nextRecord(value_);
+}
+
+template <typename T, typename RecordDecoder>
+void Scanner<T, RecordDecoder>::next() {
+  if (!valid_) return;
+  ++index_;
+  if (index_ < file_->blockInfo(current_block_num_).accumlated_records) {
+    valid_ = decoder_.nextRecord(value_);
+    return;
+  }
+  valid_ = current_block_num_ + 1 < static_cast<int64_t>(file_->numBlocks()) &&
+      loadDataBlock(current_block_num_ + 1) && decoder_.nextRecord(value_);
+}
+
+}  // namespace stbe
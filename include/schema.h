@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdint.h>
+
+#include <string>
+#include <type_traits>
+
+#include "memblock.h"
+
+namespace stbe {
+
+// Generates a record marshaller from a list of members, which are encoded
+// in the given order. Members are std::string or uint32_t.
+//
+//   struct Record {
+//     std::string category;
+//     uint32_t total_items;
+//   };
+//   template <>
+//   class recordMarshaller<Record>
+//       : public schemaMarshaller<Record, &Record::category, &Record::total_items> {};
+//
+// The string fields are numbered in the order they appear, as scan() and
+// the field summaries count them. All calls into BlockEncoder and
+// BlockDecoder are resolved at compile time.
+template <typename Record, auto... Members>
+class schemaMarshaller {
+private:
+  template <auto Member>
+  using memberType = std::remove_cv_t<
+      std::remove_reference_t<decltype(std::declval<Record&>().*Member)>>;
+
+  template <auto Member>
+  static constexpr bool isString() {
+    return std::is_same<memberType<Member>, std::string>::value;
+  }
+
+  static_assert(sizeof...(Members) > 0, "a schema needs at least one field");
+  static_assert(((isString<Members>() ||
+                  std::is_same<memberType<Members>, uint32_t>::value) && ...),
+                "schema fields must be std::string or uint32_t");
+
+  template <typename TrieEncoder>
+  static void addField(TrieEncoder& trie_encoder, const std::string& value) {
+    trie_encoder.addString2Trie(value);
+  }
+  template <typename TrieEncoder>
+  static void addField(TrieEncoder&, uint32_t) {}
+
+  template <typename TrieEncoder>
+  static void encodeField(TrieEncoder& trie_encoder, const std::string&, size_t& string_index) {
+    trie_encoder.encodeString(string_index++);
+  }
+  template <typename TrieEncoder>
+  static void encodeField(TrieEncoder& trie_encoder, uint32_t value, size_t&) {
+    trie_encoder.encodeUint32(value);
+  }
+
+  template <typename TrieDecoder>
+  static bool decodeField(TrieDecoder& trie_decoder, std::string& value) {
+    return trie_decoder.decodeString(value);
+  }
+  template <typename TrieDecoder>
+  static bool decodeField(TrieDecoder& trie_decoder, uint32_t& value) {
+    return trie_decoder.decodeUint32(value);
+  }
+
+  template <auto Member, typename TrieDecoder>
+  static bool skipField(TrieDecoder& trie_decoder) {
+    if constexpr (isString<Member>()) {
+      return trie_decoder.skipString();
+    } else {
+      return trie_decoder.skipUint32();
+    }
+  }
+
+public:
+  static constexpr uint32_t kNumVarints = sizeof...(Members);
+  static float avgSize() {
+    return kAvgVarintSize * sizeof...(Members);
+  }
+  template <typename TrieEncoder>
+  static void add2Trie(TrieEncoder& trie_encoder, const Record& record) {
+    (addField(trie_encoder, record.*Members), ...);
+  }
+  template <typename TrieEncoder>
+  static void encode(TrieEncoder& trie_encoder, const Record& record) {
+    size_t string_index = 0;
+    (encodeField(trie_encoder, record.*Members, string_index), ...);
+  }
+
+  template <typename TrieDecoder>
+  static bool decode(TrieDecoder& trie_decoder, Record& record) {
+    return (decodeField(trie_decoder, record.*Members) && ...);
+  }
+  template <typename TrieDecoder>
+  static bool skip(TrieDecoder& trie_decoder) {
+    return (skipField<Members>(trie_decoder) && ...);
+  }
+};
+
+}  // namespace stbe
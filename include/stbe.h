@@ -1,8 +1,17 @@
 #pragma once
 
+#include <condition_variable>
+#include <deque>
 #include <fstream>
+#include <mutex>
+#include <numeric>
+#include <thread>
 
+#include "compression.h"
+#include "dictionary.h"
+#include "file_handle.h"
 #include "memblock.h"
+#include "util/crc32c.h"
 
 namespace stbe {
 
@@ -11,84 +20,293 @@ constexpr size_t kDefaultBlockSize = 4 * 1024 * 1024;  // 4MB
 template <typename T, typename RecordEncoder = recordMarshaller<T> >
 class Builder{
 private:
-  BlockEncoder<T, RecordEncoder> encoder_;
+  using Encoder = BlockEncoder<T, RecordEncoder>;
+
+  std::unique_ptr<Encoder> encoder_;  // the block being filled
   std::ofstream os_;
   uint32_t block_size_;
+  uint32_t restart_interval_;
+  bool child_index_ = false;
+  bool columnar_ = false;
+  bool field_tries_ = false;
+  bool streaming_ = false;
+  std::shared_ptr<const Dictionary> dictionary_;
+  const Codec* codec_ = nullptr;  // nullptr stores blocks uncompressed
+  std::string compressed_;
   // records offset and num of records in each block.
-  std::vector<std::pair<uint32_t, uint32_t>> block_info_;
-
-  void writeBlock(const std::string& block);
-  size_t buildIndexBlock();
+  std::vector<std::pair<uint64_t, uint32_t>> block_info_;
+  // field summaries of each block, see enableFieldSummaries().
+  bool field_summaries_ = false;
+  int bits_per_key_ = 0;
+  std::vector<std::string> block_summaries_;
+  bool failed_ = false;  // a block could not be serialized, see finalize()
+
+  // Parallel encoding, see enableParallelEncoding(). Full blocks wait in
+  // pending_ in file order, workers serialize them in any order and
+  // whichever thread finds the front of pending_ serialized writes it out.
+  struct PendingBlock {
+    explicit PendingBlock(std::unique_ptr<Encoder> e) : encoder(std::move(e)) {}
+    std::unique_ptr<Encoder> encoder;
+    const std::string* raw = nullptr;  // set once serialized
+    uint8_t codec = kNoCompression;
+    std::string compressed;  // the block to write, unless kNoCompression
+    uint32_t crc = 0;  // masked crc32c of the block to write
+    std::string summaries;
+  };
+  std::vector<std::thread> workers_;
+  uint32_t max_inflight_blocks_ = 0;
+  std::mutex mutex_;
+  std::condition_variable work_cv_;  // signals workers_ of new jobs_
+  std::condition_variable done_cv_;  // signals add() of written blocks
+  std::deque<PendingBlock> pending_;
+  std::deque<PendingBlock*> jobs_;  // pending_ blocks not picked up yet
+  std::vector<std::unique_ptr<Encoder>> free_encoders_;
+  uint32_t num_encoders_ = 0;
+  bool writing_ = false;
+  bool stop_ = false;
+
+  static uint32_t blockChecksum(const std::string& block, uint8_t codec) {
+    uint32_t crc = crc32c::Value(block.data(), block.size());
+    return crc32c::Mask(crc32c::Extend(crc, reinterpret_cast<const char*>(&codec), 1));
+  }
+  // Returns the block to write: the compressed form stored in *compressed if
+  // codec_ saves enough space, raw otherwise.
+  const std::string& compressBlock(const std::string& raw, std::string* compressed,
+                                   uint8_t* codec) const;
+  void writeBlock(const std::string& block, uint8_t codec, uint32_t crc);
+  void writeBlock(const std::string& block) {
+    writeBlock(block, kNoCompression, blockChecksum(block, kNoCompression));
+  }
+  uint64_t buildIndexBlock();
   void finishBlock();
+  void finishBlockParallel();
+  void workerLoop();
+  // Writes serialized blocks from the front of pending_, mutex_ is held.
+  void writeReadyBlocks(std::unique_lock<std::mutex>& lock);
+  void stopWorkers();
 
 public:
-  explicit Builder(uint32_t block_size = kDefaultBlockSize);
+  // restart_interval: records between restart points in a data block, which
+  // bounds the records skipped by a random access. 0 disables them.
+  explicit Builder(uint32_t block_size = kDefaultBlockSize,
+                   uint32_t restart_interval = kDefaultRestartInterval);
   Builder(const std::string& fname, std::vector<T>& records,
-          uint32_t block_size = kDefaultBlockSize);
+          uint32_t block_size = kDefaultBlockSize,
+          uint32_t restart_interval = kDefaultRestartInterval);
+  ~Builder();
   void initialize(const std::string& filename);
+  // Serializes full blocks on num_threads worker threads while add() goes on
+  // filling the next one. At most max_inflight_blocks full blocks are held
+  // in memory, add() waits for the writer beyond that. The output is the
+  // same as without it. Call before the first add().
+  void enableParallelEncoding(uint32_t num_threads, uint32_t max_inflight_blocks);
+  // Adds child lists to the tries of data blocks, so they can be searched by
+  // value (BlockDecoder::findExact() and findPrefix()). Call before the
+  // first add().
+  void enableChildIndex() {
+    child_index_ = true;
+    encoder_->setChildIndex(true);
+  }
+  // Stores the fields of data blocks column by column, so readers decode
+  // only the fields they project, see Cursor::setProjection(). Call before
+  // the first add().
+  void enableColumnar() {
+    static_assert(marshallerVarints<RecordEncoder>::value > 0,
+                  "records must be a fixed # of varints");
+    columnar_ = true;
+    encoder_->setColumnar(true);
+  }
+  // Gives every string field of data blocks a trie of its own, see
+  // BlockEncoder::setFieldTries(). Call before the first add().
+  void enableFieldTries() {
+    field_tries_ = true;
+    encoder_->setFieldTries(true);
+  }
+  // Encodes records as they are added instead of keeping copies of them
+  // until a block is full, which bounds memory by the encoded blocks, see
+  // BlockEncoder::setStreaming(). The file is the same either way. Call
+  // before the first add().
+  void enableStreaming() {
+    streaming_ = true;
+    encoder_->setStreaming(true);
+  }
+  // Stores dictionary once in the file and has data blocks refer to it for
+  // the values it holds instead of adding them to their own tries. Meant for
+  // fields with a few thousand distinct values repeated in every block.
+  // Call before the first add().
+  void setDictionary(std::shared_ptr<const Dictionary> dictionary) {
+    dictionary_ = dictionary;
+    encoder_->setDictionary(std::move(dictionary));
+  }
+  // Builds the dictionary from the values of string fields frequent in
+  // sample, e.g. the first records or a pass over a part of the input, see
+  // Dictionary::selectValues().
+  void setDictionary(const std::vector<T>& sample, size_t max_values = 4096);
+  // Keeps min/max of every string field of each block in the index block,
+  // along with a bloom filter of bits_per_key bits per distinct value
+  // (none with 0), so readers skip blocks without reading them, see
+  // FileHandle::blockMayMatch(). Call before the first add().
+  void enableFieldSummaries(int bits_per_key = 10) {
+    field_summaries_ = true;
+    bits_per_key_ = bits_per_key;
+    encoder_->setFieldSummaries(true, bits_per_key);
+  }
+  // Compresses data blocks with the codec registered as codec_id, see
+  // compression.h. Blocks that do not shrink by 1/8 are stored as they are.
+  // Call before the first add().
+  bool setCompression(uint8_t codec_id);
   
   void add(const T& record);
   void add(const std::vector<T>& records);
-  void finalize();
+  // Writes the index block and the footer. Returns false if a block was left
+  // out of the file because BlockEncoder::serialize() rejected it.
+  bool finalize();
 };
 
-	
+// Decodes records of a FileHandle. A Cursor holds all the mutable decoding
+// state, so threads sharing one FileHandle each use a Cursor of their own.
 template <typename T, typename RecordDecoder = recordMarshaller<T> >
-class Decoder {
+class Cursor {
 private:
+  std::shared_ptr<const FileHandle> file_;
   BlockDecoder<T, RecordDecoder> decoder_;
-  std::ifstream inf_;
-  std::string buf_;  // data buffer for decoder
-  uint32_t index_block_offset_ = 0;
-  uint32_t file_size_ = 0;
-  int32_t current_block_num_ = -1;
-
-  struct BlockInfo {
-    uint32_t offset;
-    uint32_t num_records;
-    uint32_t accumlated_records;
-  };
-  std::vector<BlockInfo> blocks_info_;
-
-  bool loadBlockIndex();
-  bool loadBlock(uint32_t offset, uint32_t limit);
-  bool loadDataBlock(uint32_t offset);
+  FileHandle::Block block_;  // the block decoder_ works on
+  int64_t current_block_num_ = -1;
 
-  // locate the block number by record_index, returns blocks_info_.size() + 1 
-  // if record_index is out of range.
-  uint32_t locateBlock(uint32_t record_index, uint32_t begin, uint32_t end) const;
-  uint32_t locateBlock(uint32_t record_index) const {
-    return locateBlock(record_index, 0, blocks_info_.size() - 1);
-  }
+  bool loadDataBlock(uint32_t index);
 
 public:
-  //Decoder() {};
-  explicit Decoder(const std::string& fname);
+  explicit Cursor(std::shared_ptr<const FileHandle> file);
 
-  size_t totalRecords() {
-    if (blocks_info_.empty()) {
-      return 0;
-    }
-    return blocks_info_.back().accumlated_records;
+  const std::shared_ptr<const FileHandle>& file() const {
+    return file_;
+  }
+  uint64_t totalRecords() {
+    return file_->totalRecords();
   }
   bool nextRecord(T& record);
-  const T operator[](const int index);
+  const T operator[](const uint64_t index);
+  // Looks up n records at once, values[i] gets record indices[i], or T{} if
+  // there is none. Whatever the order of indices, each block is loaded once
+  // and decoded in a single forward pass.
+  void multiGet(const uint64_t* indices, size_t n, T* values);
+  void multiGet(const std::vector<uint64_t>& indices, std::vector<T>* values) {
+    values->resize(indices.size());
+    multiGet(indices.data(), indices.size(), values->data());
+  }
+
+  // Calls callback(index, record) for every record of the file whose string
+  // field field_index matches predicate, see BlockDecoder::scan().
+  template <typename Callback>
+  bool scan(uint32_t field_index, const StringPredicate& predicate, Callback&& callback);
+
+  // Decode only these fields of columnar blocks, see
+  // BlockDecoder::setProjection().
+  void setProjection(const std::vector<uint32_t>& fields) {
+    decoder_.setProjection(fields);
+  }
+
+  // Memoize decoded strings per block, see BlockDecoder::setMemo().
+  void setMemo(bool enabled) {
+    decoder_.setMemo(enabled);
+  }
+  const typename BlockDecoder<T, RecordDecoder>::MemoStats& memoStats() const {
+    return decoder_.memoStats();
+  }
+};
+
+// A Cursor over a file of its own. Use file() to open more Cursors on the
+// same file from other threads.
+template <typename T, typename RecordDecoder = recordMarshaller<T> >
+class Decoder : public Cursor<T, RecordDecoder> {
+public:
+  explicit Decoder(const std::string& fname,
+                   const DecoderOptions& options = DecoderOptions())
+      : Cursor<T, RecordDecoder>(std::make_shared<const FileHandle>(fname, options)) {}
 };
 
 // Templates implementation
 
 template <typename T, typename RecordEncoder>
-Builder<T, RecordEncoder>::Builder(uint32_t block_size) : block_size_(block_size) {
+Builder<T, RecordEncoder>::Builder(uint32_t block_size, uint32_t restart_interval)
+    : encoder_(new Encoder(restart_interval)), block_size_(block_size),
+      restart_interval_(restart_interval) {
 }
 
 template <typename T, typename RecordEncoder>
 Builder<T, RecordEncoder>::Builder(const std::string& fname, std::vector<T>& records,
-                 uint32_t block_size) : block_size_(block_size) {
+                 uint32_t block_size, uint32_t restart_interval)
+    : encoder_(new Encoder(restart_interval)), block_size_(block_size),
+      restart_interval_(restart_interval) {
   initialize(fname);
   add(records);
   finalize();
 }
 
+template <typename T, typename RecordEncoder>
+Builder<T, RecordEncoder>::~Builder() {
+  stopWorkers();
+}
+
+template <typename T, typename RecordEncoder>
+void Builder<T, RecordEncoder>::enableParallelEncoding(uint32_t num_threads,
+                                                       uint32_t max_inflight_blocks) {
+  if (num_threads == 0 || !workers_.empty()) return;
+  max_inflight_blocks_ = std::max(max_inflight_blocks, 1u);
+  num_encoders_ = 1;  // encoder_
+  stop_ = false;
+  for (uint32_t i = 0; i < num_threads; ++i) {
+    workers_.emplace_back(&Builder::workerLoop, this);
+  }
+}
+
+template <typename T, typename RecordEncoder>
+bool Builder<T, RecordEncoder>::setCompression(uint8_t codec_id) {
+  if (codec_id == kNoCompression) {
+    codec_ = nullptr;
+    return true;
+  }
+  const Codec* codec = getCodec(codec_id);
+  if (codec == nullptr) {
+    std::cerr << "Unknown codec " << static_cast<int>(codec_id) << "." << std::endl;
+    return false;
+  }
+  codec_ = codec;
+  return true;
+}
+
+template <typename T, typename RecordEncoder>
+void Builder<T, RecordEncoder>::setDictionary(const std::vector<T>& sample,
+                                              size_t max_values) {
+  // collects the string fields the marshaller would add to a trie.
+  struct ValueCollector : public TrieValueEncoder {
+    std::vector<std::string> values;
+    void addString2Trie(const std::string& value) override {
+      values.push_back(value);
+    }
+    void encodeString(size_t) override {}
+    void encodeUint32(uint32_t) override {}
+  } collector;
+  for (const T& record : sample) {
+    RecordEncoder::add2Trie(collector, record);
+  }
+  setDictionary(std::make_shared<const Dictionary>(
+      Dictionary::selectValues(collector.values, max_values)));
+}
+
+template <typename T, typename RecordEncoder>
+void Builder<T, RecordEncoder>::stopWorkers() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_cv_.notify_all();
+  for (auto& w : workers_) {
+    w.join();
+  }
+  workers_.clear();
+}
+
 template <typename T, typename RecordEncoder>
 void Builder<T, RecordEncoder>::initialize(const std::string& filename) {
   os_.open(filename, std::ofstream::trunc | std::ofstream::binary);
@@ -96,9 +314,9 @@ void Builder<T, RecordEncoder>::initialize(const std::string& filename) {
 
 template <typename T, typename RecordEncoder>
 void Builder<T, RecordEncoder>::add(const T& record) {
-  encoder_.add(record);
+  encoder_->add(record);
   // check if the block is over estimated size limit, then create a new block.
-  if (encoder_.estimatedSize() >= block_size_) finishBlock();
+  if (encoder_->estimatedSize() >= block_size_) finishBlock();
 }
 
 template <typename T, typename RecordEncoder>
@@ -109,117 +327,192 @@ void Builder<T, RecordEncoder>::add(const std::vector<T>& records) {
 }
 
 template <typename T, typename RecordEncoder>
-void Builder<T, RecordEncoder>::writeBlock(const std::string& block) {
-  // write a block header, currently it only contains a block length.
+const std::string& Builder<T, RecordEncoder>::compressBlock(const std::string& raw,
+                                                           std::string* compressed,
+                                                           uint8_t* codec) const {
+  *codec = kNoCompression;
+  if (codec_ == nullptr) return raw;
+  compressed->clear();
+  if (!codec_->compress(raw.data(), raw.size(), compressed) ||
+      compressed->size() >= raw.size() - raw.size() / 8) {
+    return raw;
+  }
+  *codec = codec_->id();
+  return *compressed;
+}
+
+template <typename T, typename RecordEncoder>
+void Builder<T, RecordEncoder>::writeBlock(const std::string& block, uint8_t codec,
+                                           uint32_t crc) {
+  // write a block header: block length, masked crc32c and codec of the block.
   std::string header;
   PutFixed32(&header, block.size());
+  PutFixed32(&header, crc);
+  header.push_back(static_cast<char>(codec));
   os_ << header << block;
 }
 
 template <typename T, typename RecordEncoder>
 void Builder<T, RecordEncoder>::finishBlock() {
-  block_info_.emplace_back(std::make_pair<uint32_t, uint32_t>(os_.tellp(), encoder_.numRecords()));
-  writeBlock(encoder_.serialize());
-  encoder_.clear();
+  if (!workers_.empty()) {
+    finishBlockParallel();
+    return;
+  }
+  const std::string& raw = encoder_->serialize();
+  if (raw.empty()) {
+    failed_ = true;
+    encoder_->clear();
+    return;
+  }
+  block_info_.emplace_back(std::make_pair<uint64_t, uint32_t>(os_.tellp(), encoder_->numRecords()));
+  block_summaries_.emplace_back();
+  if (field_summaries_) encoder_->buildFieldSummaries(&block_summaries_.back());
+  uint8_t codec;
+  const std::string& block = compressBlock(raw, &compressed_, &codec);
+  writeBlock(block, codec, blockChecksum(block, codec));
+  encoder_->clear();
 }
 
 template <typename T, typename RecordEncoder>
-size_t Builder<T, RecordEncoder>::buildIndexBlock() {
-  size_t index_block_offset = os_.tellp();
+void Builder<T, RecordEncoder>::finishBlockParallel() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  pending_.emplace_back(std::move(encoder_));
+  jobs_.push_back(&pending_.back());
+  work_cv_.notify_one();
+
+  // get an encoder for the next block, a new one while under the limit.
+  if (free_encoders_.empty() && num_encoders_ <= max_inflight_blocks_) {
+    ++num_encoders_;
+    encoder_.reset(new Encoder(restart_interval_));
+    encoder_->setChildIndex(child_index_);
+    if (columnar_) encoder_->setColumnar(true);
+    encoder_->setFieldTries(field_tries_);
+    encoder_->setDictionary(dictionary_);
+    encoder_->setStreaming(streaming_);
+    encoder_->setFieldSummaries(field_summaries_, bits_per_key_);
+    return;
+  }
+  done_cv_.wait(lock, [this] { return !free_encoders_.empty(); });
+  encoder_ = std::move(free_encoders_.back());
+  free_encoders_.pop_back();
+}
+
+template <typename T, typename RecordEncoder>
+void Builder<T, RecordEncoder>::workerLoop() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    work_cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+    if (jobs_.empty()) return;  // stopped and nothing left to do
+    PendingBlock* job = jobs_.front();
+    jobs_.pop_front();
+    lock.unlock();
+    // job is not touched by others until raw is set.
+    const std::string* raw = &job->encoder->serialize();
+    const std::string& block = compressBlock(*raw, &job->compressed, &job->codec);
+    job->crc = blockChecksum(block, job->codec);
+    if (field_summaries_) job->encoder->buildFieldSummaries(&job->summaries);
+    lock.lock();
+    job->raw = raw;
+    writeReadyBlocks(lock);
+  }
+}
+
+template <typename T, typename RecordEncoder>
+void Builder<T, RecordEncoder>::writeReadyBlocks(std::unique_lock<std::mutex>& lock) {
+  // only one thread writes at a time, it also picks up blocks finished by
+  // others in the meantime.
+  if (writing_) return;
+  writing_ = true;
+  while (!pending_.empty() && pending_.front().raw != nullptr) {
+    PendingBlock job = std::move(pending_.front());
+    pending_.pop_front();
+    lock.unlock();
+    if (job.raw->empty()) {
+      failed_ = true;
+    } else {
+      block_info_.emplace_back(std::make_pair<uint64_t, uint32_t>(os_.tellp(), job.encoder->numRecords()));
+      block_summaries_.emplace_back(std::move(job.summaries));
+      writeBlock(job.codec == kNoCompression ? *job.raw : job.compressed, job.codec, job.crc);
+    }
+    job.encoder->clear();
+    lock.lock();
+    free_encoders_.push_back(std::move(job.encoder));
+    done_cv_.notify_all();
+  }
+  writing_ = false;
+  done_cv_.notify_all();
+}
+
+template <typename T, typename RecordEncoder>
+uint64_t Builder<T, RecordEncoder>::buildIndexBlock() {
+  // the dictionary goes right before the index block.
+  uint64_t dictionary_offset = os_.tellp();
+  if (dictionary_ != nullptr) {
+    uint8_t codec;
+    const std::string& block = compressBlock(dictionary_->data(), &compressed_, &codec);
+    writeBlock(block, codec, blockChecksum(block, codec));
+  }
+  uint64_t index_block_offset = os_.tellp();
   std::string buf;
   // Index block consists: <# of blocks>[<block offset, # of items in block>]
-  PutVarint32(&buf, block_info_.size());
-  for(auto& b : block_info_) {
-    PutVarint32Varint32(&buf, b.first, b.second);
+  // see format.h.
+  PutVarint64(&buf, block_info_.size());
+  for (size_t i = 0; i < block_info_.size(); ++i) {
+    PutVarint64(&buf, block_info_[i].first);
+    PutVarint32(&buf, block_info_[i].second);
+    PutVarint32(&buf, block_summaries_[i].size());
+    buf.append(block_summaries_[i]);
   }
+  buf.push_back(dictionary_ != nullptr);
+  if (dictionary_ != nullptr) PutVarint64(&buf, dictionary_offset);
   writeBlock(buf);
 
   return index_block_offset; 
 }
 
 template <typename T, typename RecordEncoder>
-void Builder<T, RecordEncoder>::finalize() {
+bool Builder<T, RecordEncoder>::finalize() {
   // finish the last block if not empty.
-  if (encoder_.numRecords() > 0) {
+  if (encoder_->numRecords() > 0) {
     finishBlock();  
   }
+  if (!workers_.empty()) {
+    // wait for the writer to drain, then the workers are done for good.
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_.empty() && !writing_; });
+    lock.unlock();
+    stopWorkers();
+  }
 
   // Write the index block.
   std::string buf;
-  PutFixed32(&buf, buildIndexBlock());
+  PutFixed64(&buf, buildIndexBlock());
 
-  // Append the offset of index block as Fixed32 at the end of file.
+  // Append the footer: offset of index block, format version and magic.
+  PutFixed32(&buf, kLatestFormatVersion);
+  PutFixed64(&buf, kFooterMagic);
   os_ << buf;
   os_.close();
+  return !failed_;
 }
 
 
 
 template <typename T, typename RecordDecoder>
-Decoder<T, RecordDecoder>::Decoder(const std::string& fname) : inf_(fname, std::ifstream::binary) {
-  // go to the end of the file and read out index_block_offset_
-  int cur = inf_.tellg();
-  inf_.seekg(-sizeof(uint32_t), std::ifstream::end);
-  file_size_ = inf_.tellg();
-  char buf[sizeof(uint32_t)];
-  inf_.read(buf, sizeof(uint32_t));
-  index_block_offset_ = DecodeFixed32(buf);
-  if (!loadBlockIndex()) {
-    std::cerr << "Faild to load index block from file." << std::endl;
-  }
-  inf_.seekg(cur, std::ifstream::beg);
-}
-
-template <typename T, typename RecordDecoder>
-bool Decoder<T, RecordDecoder>::loadBlockIndex() {
-  // return true if the index block is already cached
-  if (blocks_info_.size() > 0) return true;
-  if (!loadBlock(index_block_offset_, file_size_)) return false;
-
-  // load the index block to cache
-  const char* ptr = buf_.data();
-  const char* limit = buf_.data() + buf_.size();
-  uint32_t num_blocks = 0;
-  ptr = GetVarint32Ptr(ptr, limit, &num_blocks);
-  if (ptr == nullptr) return false;
-  blocks_info_.resize(num_blocks);
-  uint32_t total_records = 0;
-  for (int i = 0; i < num_blocks; ++i) {
-    ptr = GetVarint32Ptr(ptr, limit, &blocks_info_[i].offset);
-    if (ptr == nullptr) return false;
-    ptr = GetVarint32Ptr(ptr, limit, &blocks_info_[i].num_records);
-    if (ptr == nullptr) return false;
-    total_records += blocks_info_[i].num_records;
-    blocks_info_[i].accumlated_records = total_records;
-  }
-  return true;
-}
-
-template <typename T, typename RecordDecoder>
-bool Decoder<T, RecordDecoder>::loadBlock(uint32_t offset, uint32_t limit) {
-  inf_.seekg(offset, std::ifstream::beg);
-  char header[sizeof(uint32_t)];
-  inf_.read(header, sizeof(uint32_t));
-  uint32_t block_len = DecodeFixed32(header);
-  // sanity check, verify integrity of the block 
-  if (offset + block_len + sizeof(uint32_t) > limit) return false;
-  buf_.resize(block_len);
-  inf_.read(&buf_[0], block_len);
-  return true;
+Cursor<T, RecordDecoder>::Cursor(std::shared_ptr<const FileHandle> file)
+    : file_(std::move(file)) {
+  decoder_.setDictionary(file_->dictionary().data(), file_->dictionary().size());
 }
 
 template <typename T, typename RecordDecoder>
-bool Decoder<T, RecordDecoder>::loadDataBlock(uint32_t index) {
-  if (index >= blocks_info_.size() || 
-      !loadBlock(blocks_info_[index].offset, index_block_offset_)) {
-    return false;
-  }
+bool Cursor<T, RecordDecoder>::loadDataBlock(uint32_t index) {
+  if (!file_->readDataBlock(index, &block_)) return false;
   current_block_num_ = index;
-  return decoder_.reset(buf_.data(), buf_.size());
+  return decoder_.reset(block_.data, block_.size);
 }
 
 template <typename T, typename RecordDecoder>
-bool Decoder<T, RecordDecoder>::nextRecord(T& record) {
+bool Cursor<T, RecordDecoder>::nextRecord(T& record) {
   // return false if the file cursor has already passed the last element
   bool has_record = decoder_.nextRecord(record);
   if (has_record) return true;
@@ -228,39 +521,77 @@ bool Decoder<T, RecordDecoder>::nextRecord(T& record) {
 }
 
 template <typename T, typename RecordDecoder>
-uint32_t Decoder<T, RecordDecoder>::locateBlock(uint32_t record_index, uint32_t begin, uint32_t end) const {
-  if (begin == end) {
-    return record_index < blocks_info_[begin].accumlated_records 
-        ? begin : blocks_info_.size();
-  }
-  uint32_t mid = (begin + end) / 2;
-  if (record_index <= blocks_info_[mid].accumlated_records) {
-    return locateBlock(record_index, begin, mid);
-  } else {
-    return locateBlock(record_index, mid + 1, end);
-  }
-}
+const T Cursor<T, RecordDecoder>::operator[](const uint64_t index) {
+  T record{};
+  if (file_->numBlocks() == 0) return record;  // No blocks
 
-template <typename T, typename RecordDecoder>
-const T Decoder<T, RecordDecoder>::operator[](const int index) {
-  T record;
-  if (blocks_info_.empty()) return record;  // No blocks
-
-  uint32_t block_num = locateBlock(index);
+  uint32_t block_num = file_->locateBlock(index);
   // returns empty record if index out of range or faild to load new block.
-  if (block_num >= blocks_info_.size() || 
+  if (block_num >= file_->numBlocks() || 
       (block_num != current_block_num_ && !loadDataBlock(block_num))) {
     return record;
   }
 
-  uint32_t index_offset = index;
-  index_offset -= blocks_info_[block_num].accumlated_records -
-                  blocks_info_[block_num].num_records;
+  const FileHandle::BlockInfo& info = file_->blockInfo(block_num);
+  uint32_t index_offset = index - (info.accumlated_records - info.num_records);
   if (decoder_.go(index_offset)) { 
     nextRecord(record);
   }
   return record;
 }
 
+template <typename T, typename RecordDecoder>
+template <typename Callback>
+bool Cursor<T, RecordDecoder>::scan(uint32_t field_index, const StringPredicate& predicate,
+                                    Callback&& callback) {
+  for (uint32_t b = 0; b < file_->numBlocks(); ++b) {
+    if (!file_->blockMayMatch(b, field_index, predicate)) continue;
+    if (b == current_block_num_ ? !decoder_.go(0) : !loadDataBlock(b)) return false;
+    const FileHandle::BlockInfo& info = file_->blockInfo(b);
+    uint64_t base = info.accumlated_records - info.num_records;
+    if (!decoder_.scan(field_index, predicate, [&](uint32_t i, const T& record) {
+          callback(base + i, record);
+        })) {
+      return false;
+    }
+  }
+  return true;
+}
+
+template <typename T, typename RecordDecoder>
+void Cursor<T, RecordDecoder>::multiGet(const uint64_t* indices, size_t n, T* values) {
+  // visit the records in ascending order, order holds positions in indices.
+  std::vector<size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [indices](size_t a, size_t b) {
+    return indices[a] < indices[b];
+  });
+
+  // records [block_begin, block_end) are in the current block.
+  uint64_t block_begin = 0;
+  uint64_t block_end = 0;
+  bool block_loaded = false;
+  for (size_t i = 0; i < n; ++i) {
+    size_t pos = order[i];
+    uint64_t index = indices[pos];
+    if (i > 0 && index == indices[order[i - 1]]) {
+      values[pos] = values[order[i - 1]];
+      continue;
+    }
+    values[pos] = T{};
+    if (index >= block_end) {
+      uint32_t block_num = file_->locateBlock(index);
+      if (block_num >= file_->numBlocks()) continue;  // so are the rest
+      const FileHandle::BlockInfo& info = file_->blockInfo(block_num);
+      block_begin = info.accumlated_records - info.num_records;
+      block_end = info.accumlated_records;
+      block_loaded = block_num == current_block_num_ || loadDataBlock(block_num);
+    }
+    if (block_loaded && decoder_.go(index - block_begin)) {
+      decoder_.nextRecord(values[pos]);
+    }
+  }
+}
+
 }  // namespace stbe
 
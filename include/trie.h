@@ -5,6 +5,7 @@
 #include <string>
 #include <vector>
 
+#include "util/arena.h"
 #include "util/coding.h"
 
 namespace stbe {
@@ -25,60 +26,112 @@ private:
 public:
   TriePosition() : trie_node_(nullptr) {}
   size_t getPosition() const;
+  // An id the user of the Trie may give the node, 0 until set. Unlike the
+  // position it is known before serialization.
+  uint32_t getId() const;
+  void setId(uint32_t id);
 };
 
+// A TrieNode and everything it refers to (its value and child lists) is
+// allocated from the Arena of the Trie it belongs to. Nodes are never
+// destroyed individually, Trie::clear() drops them all at once.
 class TrieNode {
 private:
-  std::string value_;
-  std::vector<std::unique_ptr<TrieNode>> children_;
+  // Number of children kept inside the node before spilling into the arena.
+  static constexpr uint32_t kInlineChildren = 2;
+  static constexpr int kEmptyKey = -1;
+
+  // Entry of the child index: first byte of a child value (kEmptyKey for an
+  // empty value) and the slot of the child in children_.
+  struct ChildKey {
+    int key;
+    uint32_t slot;
+  };
+
+  const char* value_;  // not null terminated, points into the arena
+  uint32_t value_size_;
+  uint32_t num_children_ = 0;
+  uint32_t capacity_ = kInlineChildren;
+  uint32_t id_ = 0;  // see TriePosition::getId()
+  // Children in insertion order.
+  TrieNode** children_ = inline_children_;
+  // Child slots sorted by first byte, so add() only visits children sharing
+  // the first byte of the new value. Empty-valued children sort in front.
+  ChildKey* child_index_ = inline_index_;
   size_t position_ = 0;
+  TrieNode* inline_children_[kInlineChildren];
+  ChildKey inline_index_[kInlineChildren];
+
+  TrieNode(const char* value, size_t size) : value_(value), value_size_(size) {}
+  // Creates a node whose value refers to bytes that already live in the arena.
+  static TrieNode* wrap(Arena* arena, const char* value, size_t size);
+  static int indexKey(const char* p, size_t size) {
+    return size == 0 ? kEmptyKey : static_cast<unsigned char>(*p);
+  }
+  // Returns pointer to the child just added.
+  TrieNode* addChild(Arena* arena, TrieNode* child);
+
 public:
-  TrieNode(const std::string& value = "") : value_(value) {}
+  TrieNode(const TrieNode&) = delete;
+  void operator=(const TrieNode&) = delete;
 
-  std::string& getVal() {
+  // Creates a node holding a copy of value in arena.
+  static TrieNode* create(Arena* arena, const char* value, size_t size);
+
+  const char* data() const {
     return value_;
   }
-  void setVal(const std::string& val) {
-    value_ = val;
+  size_t size() const {
+    return value_size_;
   }
   size_t getPosition() {
     return position_;
   }
+  uint32_t getId() const {
+    return id_;
+  }
+  void setId(uint32_t id) {
+    id_ = id;
+  }
   // Adds a new value to the trie, returns the last node representing the value
   // It also accumlates number of new nodes and new value size added.
-  TrieNode* add(const std::string& value, size_t position, size_t& new_nodes, size_t& new_value_size);
-  // Returns pointer to the child just added.
-  TrieNode* addChild(std::unique_ptr<TrieNode> child);
-
-  void serialize(std::string* buf, size_t parent_pos);
+  TrieNode* add(Arena* arena, const std::string& value, size_t position,
+                size_t& new_nodes, size_t& new_value_size);
 
-//  void serialize(std::ostream& os, size_t parent_pos, uint32_t& pos);
+  // With child_index, each node is followed by
+  // <# of children varint32>[<child position Fixed32>...], children in
+  // serialization order, so the trie can also be walked from the root.
+  void serialize(std::string* buf, size_t parent_pos, bool child_index);
 
-  void clear() {
-    value_.clear();
-    children_.clear();
-    position_ = 0;
-  }
   void print(std::ostream &out, size_t level) const;
 };
 
 class Trie {
 private:
-  TrieNode root_;
+  Arena arena_;
+  TrieNode* root_;
   size_t num_nodes_ = 1;
   size_t node_value_size_ = 0;
 public:
-  Trie() {}
+  Trie() : root_(TrieNode::create(&arena_, "", 0)) {}
 
   TriePosition add(const std::string& value);
   void add(const std::vector<std::string>& values);
-  void serialize(std::string* buf);
+  void serialize(std::string* buf, bool child_index = false);
   size_t estimatedSize() const {
     return node_value_size_ + static_cast<size_t>((num_nodes_ * 2) * kAvgVarintSize);
   }
+  size_t numNodes() const {
+    return num_nodes_;
+  }
 
+  // Drops all nodes in O(1), the arena keeps its blocks for the next values.
+  // TriePositions handed out before are invalidated.
   void clear() {
-    root_.clear();
+    arena_.Reset();
+    root_ = TrieNode::create(&arena_, "", 0);
+    num_nodes_ = 1;
+    node_value_size_ = 0;
   }
 
   friend std::ostream& operator<< (std::ostream &os, const Trie &trie);
@@ -0,0 +1,26 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+
+// A bloom filter with the layout of LevelDB's: bits_per_key * n bits (64 at
+// least) followed by the number of probes in a byte. Keys are added by
+// their BloomHash(), so callers can hash values once and build the filter
+// later.
+
+// Hash of data[0,n-1] for BuildBloomFilter() and BloomMayMatch().
+extern uint32_t BloomHash(const char* data, size_t n);
+
+// Appends a filter over hashes[0,n-1] to dst. About 1% false positives
+// with 10 bits per key.
+extern void BuildBloomFilter(const uint32_t* hashes, size_t n, int bits_per_key,
+                             std::string* dst);
+
+// Returns false if the key hashed to hash is certainly not in filter.
+extern bool BloomMayMatch(uint32_t hash, const char* filter, size_t len);
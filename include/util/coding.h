@@ -62,6 +62,31 @@ inline const char* GetVarsignedint64Ptr(const char* p, const char* limit,
 // Returns the length of the varint32 or varint64 encoding of "v"
 extern int VarintLength(uint64_t v);
 
+// Returns a pointer just past the n varints starting at p, or nullptr if
+// fewer than n end before limit. Only terminating bytes are counted, the
+// varints are not otherwise validated.
+//
+// Counts 32 (AVX2) or 16 (SSE2) bytes per step when the CPU supports it,
+// the implementation is picked once at runtime.
+extern const char* SkipVarints(const char* p, const char* limit, size_t n);
+
+// Portable implementation, always available.
+extern const char* SkipVarintsScalar(const char* p, const char* limit, size_t n);
+
+// Decodes the n varint32s starting at p into values[0,n-1]. Returns a
+// pointer just past them, or nullptr if the input ends early or holds a
+// malformed varint.
+//
+// Decodes up to 8 (AVX2) or 4 (SSSE3) varints of up to 4 bytes per step
+// with byte shuffles when the CPU supports it, the implementation is picked
+// once at runtime.
+extern const char* GetVarint32Batch(const char* p, const char* limit,
+                                    uint32_t* values, size_t n);
+
+// Portable implementation, always available.
+extern const char* GetVarint32BatchScalar(const char* p, const char* limit,
+                                          uint32_t* values, size_t n);
+
 // Lower-level versions of Put... that write directly into a character buffer
 // REQUIRES: dst has enough space for the value being written
 extern void EncodeFixed16(char* dst, uint16_t value);
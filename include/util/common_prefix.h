@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stddef.h>
+
+// Returns the length of the longest common prefix of the n bytes at a and
+// the n bytes at b. Never reads past a + n or b + n.
+//
+// Compares 32 (AVX2) or 16 (SSE2) bytes per step when the CPU supports it,
+// the implementation is picked once at runtime.
+extern size_t CommonPrefixLength(const char* a, const char* b, size_t n);
+
+// Portable implementation, always available.
+extern size_t CommonPrefixLengthScalar(const char* a, const char* b, size_t n);
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+
+#include <string>
+
+// A byte-oriented LZ77 compressor in the style of the LZ4 block format.
+// It has no entropy coding stage, which keeps decompression close to
+// memcpy speed.
+//
+// Compressed layout: <uncompressed length varint32> followed by sequences
+// of
+//   <token: literal length (high 4 bits), match length - 4 (low 4 bits)>
+//   [<literal length - 15, as 255 bytes and a final byte < 255>]
+//   <literals>
+//   <match offset Fixed16>[<match length - 19, encoded as above>]
+// where the last sequence has literals only.
+namespace lz {
+
+// Appends the compressed form of input[0,n-1] to output.
+extern void Compress(const char* input, size_t n, std::string* output);
+
+// Stores the data compressed by Compress() in input[0,n-1] to output.
+// Returns false if input is corrupt.
+extern bool Uncompress(const char* input, size_t n, std::string* output);
+
+}  // namespace lz
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h>
+#include <string>
+
+// A read-only memory mapping of a whole file (POSIX only).
+class MmapFile {
+ public:
+  // Access pattern hints passed on to madvise().
+  enum Advice {
+    kNormal,
+    kSequential,  // scans
+    kRandom,      // point lookups
+    kWillNeed,
+  };
+
+  struct Options {
+    Advice advice = kNormal;
+    // Ask for transparent huge pages where supported (MADV_HUGEPAGE).
+    bool huge_pages = false;
+    // Fault in the whole file when mapping it (MAP_POPULATE).
+    bool populate = false;
+  };
+
+  MmapFile() {}
+  ~MmapFile();
+
+  // No copying allowed
+  MmapFile(const MmapFile&) = delete;
+  void operator=(const MmapFile&) = delete;
+
+  // Maps fname, unmapping any previous file. Returns false on error.
+  bool Open(const std::string& fname, const Options& options);
+  void Close();
+  // Changes the access pattern hint of the whole mapping.
+  bool Advise(Advice advice) const;
+  // Changes it for the pages holding [offset, offset + len) only.
+  bool Advise(size_t offset, size_t len, Advice advice) const;
+
+  bool is_open() const { return data_ != nullptr; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+};
@@ -0,0 +1,103 @@
+#include "block_cache.h"
+
+namespace stbe {
+
+namespace {
+// Mixes both halves of the key, the low bits select the shard.
+inline uint64_t mix(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+}  // namespace
+
+size_t BlockCache::KeyHash::operator()(const Key& key) const {
+  return static_cast<size_t>(mix(key.file_id * 0x9e3779b97f4a7c15ULL ^ key.offset));
+}
+
+BlockCache::BlockCache(size_t capacity, int num_shard_bits)
+    : capacity_(capacity),
+      shard_mask_((size_t{1} << num_shard_bits) - 1),
+      shards_(size_t{1} << num_shard_bits) {
+}
+
+uint64_t BlockCache::newFileId() {
+  static std::atomic<uint64_t> next_file_id{1};
+  return next_file_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+BlockCache::Handle BlockCache::lookup(uint64_t file_id, uint64_t offset) {
+  Key key{file_id, offset};
+  Shard& shard = shardFor(key);
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.map.find(key);
+  if (it == shard.map.end()) {
+    ++shard.misses;
+    return nullptr;
+  }
+  ++shard.hits;
+  shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+  return it->second->second;
+}
+
+BlockCache::Handle BlockCache::insert(uint64_t file_id, uint64_t offset,
+                                      std::string block) {
+  Key key{file_id, offset};
+  Handle handle = std::make_shared<const std::string>(std::move(block));
+  size_t index = KeyHash()(key) & shard_mask_;
+  {
+    Shard& shard = shards_[index];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.map.find(key);
+    if (it != shard.map.end()) {
+      shard.usage -= it->second->second->size();
+      usage_.fetch_sub(it->second->second->size(), std::memory_order_relaxed);
+      shard.lru.erase(it->second);
+      shard.map.erase(it);
+    }
+    // a block beyond capacity is not kept, it would only push out the rest.
+    if (handle->size() > capacity_) return handle;
+    shard.lru.emplace_front(key, handle);
+    shard.map.emplace(key, shard.lru.begin());
+    shard.usage += handle->size();
+    usage_.fetch_add(handle->size(), std::memory_order_relaxed);
+    evict(shard, 1);
+  }
+  // the shard ran out of blocks to evict but the new one, take from the
+  // others one at a time, never holding two locks.
+  for (size_t i = 1; i < shards_.size() && usage_.load(std::memory_order_relaxed) > capacity_;
+       ++i) {
+    Shard& shard = shards_[(index + i) & shard_mask_];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    evict(shard, 0);
+  }
+  return handle;
+}
+
+void BlockCache::evict(Shard& shard, size_t keep) {
+  while (usage_.load(std::memory_order_relaxed) > capacity_ && shard.lru.size() > keep) {
+    auto& victim = shard.lru.back();
+    shard.usage -= victim.second->size();
+    usage_.fetch_sub(victim.second->size(), std::memory_order_relaxed);
+    shard.map.erase(victim.first);
+    shard.lru.pop_back();
+    ++shard.evictions;
+  }
+}
+
+BlockCache::Stats BlockCache::stats() const {
+  Stats stats;
+  for (auto& shard : shards_) {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    stats.hits += shard.hits;
+    stats.misses += shard.misses;
+    stats.evictions += shard.evictions;
+    stats.usage += shard.usage;
+  }
+  return stats;
+}
+
+}  // namespace stbe
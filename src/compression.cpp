@@ -0,0 +1,47 @@
+#include "compression.h"
+
+#include <atomic>
+
+#include "util/lz.h"
+
+namespace stbe {
+
+namespace {
+
+class LZCodec : public Codec {
+public:
+  uint8_t id() const override { return kLZCompression; }
+  const char* name() const override { return "lz"; }
+  bool compress(const char* input, size_t n, std::string* output) const override {
+    lz::Compress(input, n, output);
+    return true;
+  }
+  bool uncompress(const char* input, size_t n, std::string* output) const override {
+    return lz::Uncompress(input, n, output);
+  }
+};
+
+std::atomic<const Codec*>* codecs() {
+  static std::atomic<const Codec*>* registry = [] {
+    static std::atomic<const Codec*> table[256] = {};
+    static const LZCodec lz_codec;
+    table[kLZCompression].store(&lz_codec);
+    return table;
+  }();
+  return registry;
+}
+
+}  // namespace
+
+const Codec* getCodec(uint8_t id) {
+  return codecs()[id].load(std::memory_order_acquire);
+}
+
+bool registerCodec(const Codec* codec) {
+  if (codec == nullptr || codec->id() == kNoCompression) return false;
+  const Codec* expected = nullptr;
+  return codecs()[codec->id()].compare_exchange_strong(expected, codec,
+                                                       std::memory_order_acq_rel);
+}
+
+}  // namespace stbe
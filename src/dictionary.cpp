@@ -0,0 +1,48 @@
+#include "dictionary.h"
+
+#include <algorithm>
+
+#include "trie.h"
+#include "util/coding.h"
+
+namespace stbe {
+
+Dictionary::Dictionary(const std::vector<std::string>& values) {
+  Trie trie;
+  std::vector<std::pair<const std::string*, TriePosition>> nodes;
+  for (const std::string& value : values) {
+    if (positions_.emplace(value, 0).second) {
+      nodes.emplace_back(&value, trie.add(value));
+    }
+  }
+  // node positions are known once serialized.
+  PutFixed32(&data_, 0);
+  trie.serialize(&data_);
+  for (auto& node : nodes) {
+    positions_[*node.first] = node.second.getPosition();
+  }
+}
+
+std::vector<std::string> Dictionary::selectValues(const std::vector<std::string>& samples,
+                                                  size_t max_values) {
+  std::unordered_map<std::string, size_t> counts;
+  for (const std::string& value : samples) {
+    ++counts[value];
+  }
+  std::vector<std::pair<size_t, const std::string*>> frequent;
+  for (auto& entry : counts) {
+    if (entry.second >= 2) frequent.emplace_back(entry.second, &entry.first);
+  }
+  // most frequent first, ties by value so the choice is deterministic.
+  std::sort(frequent.begin(), frequent.end(), [](const auto& a, const auto& b) {
+    return a.first != b.first ? a.first > b.first : *a.second < *b.second;
+  });
+  if (frequent.size() > max_values) frequent.resize(max_values);
+  std::vector<std::string> values;
+  for (auto& entry : frequent) {
+    values.push_back(*entry.second);
+  }
+  return values;
+}
+
+}  // namespace stbe
@@ -0,0 +1,331 @@
+#include "file_handle.h"
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <iostream>
+
+#include "compression.h"
+#include "util/bloom.h"
+#include "util/coding.h"
+#include "util/crc32c.h"
+
+namespace stbe {
+
+namespace {
+// Reads the block header at offset into header and the block following it
+// into buf, sized to the expected block length, with as few preadv() calls
+// as possible.
+bool readHeaderAndBlock(int fd, uint64_t offset, char* header,
+                        size_t header_size, std::string* buf) {
+  struct iovec iov[2];
+  iov[0].iov_base = header;
+  iov[0].iov_len = header_size;
+  iov[1].iov_base = buf->empty() ? nullptr : &(*buf)[0];
+  iov[1].iov_len = buf->size();
+  struct iovec* next = iov;
+  int count = 2;
+  while (count > 0) {
+    ssize_t n = preadv(fd, next, count, offset);
+    if (n <= 0) return false;
+    offset += n;
+    // skip what has been filled.
+    while (count > 0 && static_cast<size_t>(n) >= next->iov_len) {
+      n -= next->iov_len;
+      ++next;
+      --count;
+    }
+    if (count > 0) {
+      next->iov_base = static_cast<char*>(next->iov_base) + n;
+      next->iov_len -= n;
+    }
+  }
+  return true;
+}
+}  // namespace
+
+FileHandle::FileHandle(const std::string& fname, const DecoderOptions& options)
+    : verify_checksums_(options.verify_checksums) {
+  char footer[kFooterSize];
+  size_t footer_len = 0;
+  uint64_t file_size = 0;
+  if (options.use_mmap) {
+    if (!mmap_.Open(fname, options.mmap)) {
+      std::cerr << "Faild to map file." << std::endl;
+      return;
+    }
+    file_size = mmap_.size();
+    footer_len = std::min<uint64_t>(file_size, kFooterSize);
+    memcpy(footer, mmap_.data() + file_size - footer_len, footer_len);
+  } else {
+    fd_ = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+    off_t size = fd_ < 0 ? -1 : lseek(fd_, 0, SEEK_END);
+    footer_len = std::min<off_t>(std::max<off_t>(size, 0), kFooterSize);
+    if (size < 0 ||
+        pread(fd_, footer, footer_len, size - footer_len) !=
+            static_cast<ssize_t>(footer_len)) {
+      std::cerr << "Faild to open file." << std::endl;
+      return;
+    }
+    file_size = size;
+    if (options.block_cache != nullptr) {
+      block_cache_ = options.block_cache;
+      file_id_ = BlockCache::newFileId();
+    }
+  }
+  if (!parseFooter(footer, footer_len, file_size)) {
+    std::cerr << "Faild to parse footer of file." << std::endl;
+    return;
+  }
+  if (!loadBlockIndex()) {
+    std::cerr << "Faild to load index block from file." << std::endl;
+    blocks_info_.clear();
+  }
+}
+
+FileHandle::~FileHandle() {
+  if (fd_ >= 0) close(fd_);
+}
+
+bool FileHandle::parseFooter(const char* footer, size_t footer_len, uint64_t file_size) {
+  if (footer_len >= kFooterSize &&
+      DecodeFixed64(footer + footer_len - sizeof(uint64_t)) == kFooterMagic) {
+    const char* ptr = footer + footer_len - kFooterSize;
+    format_version_ = DecodeFixed32(ptr + sizeof(uint64_t));
+    if (format_version_ < kFormatVersion2 || format_version_ > kLatestFormatVersion) {
+      return false;
+    }
+    index_block_offset_ = DecodeFixed64(ptr);
+    footer_offset_ = file_size - kFooterSize;
+  } else {
+    // version 1 files have no magic, just the Fixed32 index block offset.
+    if (footer_len < kFooterSizeV1) return false;
+    format_version_ = kFormatVersion1;
+    index_block_offset_ = DecodeFixed32(footer + footer_len - kFooterSizeV1);
+    footer_offset_ = file_size - kFooterSizeV1;
+  }
+  return index_block_offset_ < footer_offset_;
+}
+
+bool FileHandle::loadBlockIndex() {
+  Block block;
+  // the index block is read only once, always verify it.
+  if (!readBlock(index_block_offset_, footer_offset_,
+                 verify_checksums_ != kVerifyNever, &block)) {
+    return false;
+  }
+
+  // load the index block to cache
+  const char* ptr = block.data;
+  const char* limit = block.data + block.size;
+  uint64_t num_blocks = 0;
+  if (format_version_ == kFormatVersion1) {
+    uint32_t n;
+    ptr = GetVarint32Ptr(ptr, limit, &n);
+    num_blocks = n;
+  } else {
+    ptr = GetVarint64Ptr(ptr, limit, &num_blocks);
+  }
+  // every block takes at least two bytes in the index.
+  if (ptr == nullptr || num_blocks > static_cast<uint64_t>(limit - ptr) / 2) {
+    return false;
+  }
+  blocks_info_.resize(num_blocks);
+  verified_.reset(new std::atomic<bool>[num_blocks]());
+  uint64_t total_records = 0;
+  for (uint64_t i = 0; i < num_blocks; ++i) {
+    if (format_version_ == kFormatVersion1) {
+      uint32_t offset;
+      ptr = GetVarint32Ptr(ptr, limit, &offset);
+      blocks_info_[i].offset = offset;
+    } else {
+      ptr = GetVarint64Ptr(ptr, limit, &blocks_info_[i].offset);
+    }
+    if (ptr == nullptr) return false;
+    ptr = GetVarint32Ptr(ptr, limit, &blocks_info_[i].num_records);
+    if (ptr == nullptr) return false;
+    if (format_version_ >= kFormatVersion5) {
+      uint32_t size;
+      ptr = GetVarint32Ptr(ptr, limit, &size);
+      if (ptr == nullptr || size > static_cast<uint64_t>(limit - ptr)) return false;
+      blocks_info_[i].summaries_offset = summaries_.size();
+      blocks_info_[i].summaries_size = size;
+      summaries_.append(ptr, size);
+      ptr += size;
+    }
+    total_records += blocks_info_[i].num_records;
+    blocks_info_[i].accumlated_records = total_records;
+  }
+  data_end_offset_ = index_block_offset_;
+  if (format_version_ >= kFormatVersion6) {
+    if (ptr == limit) return false;
+    if (*ptr++ != 0) {
+      uint64_t offset;
+      ptr = GetVarint64Ptr(ptr, limit, &offset);
+      // the dictionary follows the data blocks.
+      if (ptr == nullptr || offset >= index_block_offset_ ||
+          (num_blocks > 0 && offset <= blocks_info_.back().offset)) {
+        return false;
+      }
+      // it is read only once too, always verify it.
+      if (!readBlock(offset, index_block_offset_, verify_checksums_ != kVerifyNever,
+                     &dictionary_)) {
+        return false;
+      }
+      data_end_offset_ = offset;
+    }
+  }
+  return true;
+}
+
+bool FileHandle::readBlock(uint64_t offset, uint64_t limit, bool verify,
+                           Block* block) const {
+  const size_t header_size = blockHeaderSize(format_version_);
+  if (offset + header_size > limit) return false;
+  const char* header;
+  char header_buf[2 * sizeof(uint32_t) + 1];
+  uint32_t block_len;
+  if (mmap_.is_open()) {
+    header = mmap_.data() + offset;
+    block_len = DecodeFixed32(header);
+    // sanity check, verify integrity of the block
+    if (offset + block_len + header_size > limit) return false;
+    block->data = mmap_.data() + offset + header_size;
+    block->size = block_len;
+  } else {
+    // blocks are written back to back, so the header and the block are read
+    // in one go.
+    header = header_buf;
+    block->buf.resize(limit - offset - header_size);
+    if (!readHeaderAndBlock(fd_, offset, header_buf, header_size, &block->buf)) {
+      return false;
+    }
+    block_len = DecodeFixed32(header);
+    // sanity check, verify integrity of the block
+    if (block_len > block->buf.size()) return false;
+    block->buf.resize(block_len);
+    block->data = block->buf.data();
+    block->size = block->buf.size();
+  }
+  block->handle.reset();
+
+  if (verify && format_version_ >= kFormatVersion3) {
+    uint32_t expected = crc32c::Unmask(DecodeFixed32(header + sizeof(uint32_t)));
+    uint32_t crc = crc32c::Value(block->data, block->size);
+    if (format_version_ >= kFormatVersion4) {
+      crc = crc32c::Extend(crc, header + 2 * sizeof(uint32_t), 1);
+    }
+    if (crc != expected) {
+      std::cerr << "Block checksum mismatch at offset " << offset << "." << std::endl;
+      return false;
+    }
+  }
+
+  uint8_t codec_id = format_version_ >= kFormatVersion4
+      ? static_cast<uint8_t>(header[2 * sizeof(uint32_t)]) : kNoCompression;
+  if (codec_id != kNoCompression) {
+    const Codec* codec = getCodec(codec_id);
+    if (codec == nullptr) {
+      std::cerr << "Unknown codec " << static_cast<int>(codec_id) << "." << std::endl;
+      return false;
+    }
+    std::string raw;
+    if (!codec->uncompress(block->data, block->size, &raw)) {
+      std::cerr << "Faild to uncompress block at offset " << offset << "." << std::endl;
+      return false;
+    }
+    block->buf.swap(raw);
+    block->data = block->buf.data();
+    block->size = block->buf.size();
+  }
+  return true;
+}
+
+void FileHandle::prefetchDataBlock(uint32_t index) const {
+  if (!mmap_.is_open() || index >= blocks_info_.size()) return;
+  uint64_t offset = blocks_info_[index].offset;
+  uint64_t limit = index + 1 < blocks_info_.size()
+      ? blocks_info_[index + 1].offset : data_end_offset_;
+  mmap_.Advise(offset, limit - offset, MmapFile::kWillNeed);
+}
+
+bool FileHandle::readDataBlock(uint32_t index, Block* block) const {
+  if (index >= blocks_info_.size()) return false;
+  uint64_t offset = blocks_info_[index].offset;
+  uint64_t limit = index + 1 < blocks_info_.size()
+      ? blocks_info_[index + 1].offset : data_end_offset_;
+  // with kVerifyOnFirstLoad, only bytes already verified in memory are
+  // trusted: mapped blocks touched before and blocks served from the cache.
+  // A fresh pread() is always verified.
+  bool verify = verify_checksums_ == kVerifyAlways ||
+      (verify_checksums_ == kVerifyOnFirstLoad &&
+       (!mmap_.is_open() || !verified_[index].load(std::memory_order_relaxed)));
+  if (block_cache_ == nullptr) {
+    if (!readBlock(offset, limit, verify, block)) return false;
+    if (verify) verified_[index].store(true, std::memory_order_relaxed);
+    return true;
+  }
+
+  BlockCache::Handle handle = block_cache_->lookup(file_id_, offset);
+  if (handle == nullptr) {
+    if (!readBlock(offset, limit, verify, block)) return false;
+    handle = block_cache_->insert(file_id_, offset, std::move(block->buf));
+  }
+  block->data = handle->data();
+  block->size = handle->size();
+  block->handle = std::move(handle);
+  return true;
+}
+
+bool FileHandle::fieldSummary(uint32_t index, uint32_t field,
+                              FieldSummary* summary) const {
+  if (index >= blocks_info_.size()) return false;
+  const char* ptr = summaries_.data() + blocks_info_[index].summaries_offset;
+  const char* limit = ptr + blocks_info_[index].summaries_size;
+  uint32_t num_fields;
+  ptr = GetVarint32Ptr(ptr, limit, &num_fields);
+  if (ptr == nullptr || field >= num_fields) return false;
+  for (uint32_t f = 0; f <= field; ++f) {
+    for (std::string_view* s : {&summary->min, &summary->max, &summary->filter}) {
+      uint32_t size;
+      ptr = GetVarint32Ptr(ptr, limit, &size);
+      if (ptr == nullptr || size > static_cast<size_t>(limit - ptr)) return false;
+      *s = std::string_view(ptr, size);
+      ptr += size;
+    }
+  }
+  return true;
+}
+
+bool FileHandle::blockMayMatch(uint32_t index, uint32_t field,
+                               const StringPredicate& predicate) const {
+  FieldSummary summary;
+  if (!fieldSummary(index, field, &summary)) return true;
+  std::string_view operand = predicate.operand;
+  if (predicate.kind == StringPredicate::kPrefix) {
+    // values with the prefix sort in [operand, the next string without it).
+    return summary.max >= operand &&
+        (summary.min < operand || summary.min.substr(0, operand.size()) == operand);
+  }
+  if (operand < summary.min || operand > summary.max) return false;
+  return summary.filter.empty() ||
+      BloomMayMatch(BloomHash(operand.data(), operand.size()),
+                    summary.filter.data(), summary.filter.size());
+}
+
+uint32_t FileHandle::locateBlock(uint64_t record_index, uint32_t begin, uint32_t end) const {
+  if (begin == end) {
+    return record_index < blocks_info_[begin].accumlated_records 
+        ? begin : blocks_info_.size();
+  }
+  uint32_t mid = (begin + end) / 2;
+  if (record_index < blocks_info_[mid].accumlated_records) {
+    return locateBlock(record_index, begin, mid);
+  } else {
+    return locateBlock(record_index, mid + 1, end);
+  }
+}
+
+}  // namespace stbe
@@ -1,5 +1,10 @@
 #include "trie.h"
 
+#include <algorithm>
+#include <new>
+
+#include "util/common_prefix.h"
+
 namespace stbe {
 
 
@@ -7,84 +12,153 @@ size_t TriePosition::getPosition() const {
   return trie_node_->getPosition();
 }
 
+uint32_t TriePosition::getId() const {
+  return trie_node_->getId();
+}
+
+void TriePosition::setId(uint32_t id) {
+  trie_node_->setId(id);
+}
 
-TrieNode* TrieNode::add(const std::string& value, size_t position, size_t& new_nodes, size_t& new_value_size) {
+
+TrieNode* TrieNode::wrap(Arena* arena, const char* value, size_t size) {
+  return new (arena->AllocateAligned(sizeof(TrieNode))) TrieNode(value, size);
+}
+
+TrieNode* TrieNode::create(Arena* arena, const char* value, size_t size) {
+  const char* copy = "";
+  if (size > 0) {
+    char* mem = arena->Allocate(size);
+    memcpy(mem, value, size);
+    copy = mem;
+  }
+  return wrap(arena, copy, size);
+}
+
+TrieNode* TrieNode::add(Arena* arena, const std::string& value, size_t position,
+                        size_t& new_nodes, size_t& new_value_size) {
   // search for child with the same prefix
   size_t remain_size = value.size() - position;
   TrieNode* best_fully_matched_node = nullptr;
-  for (auto& node : children_) {
-    auto& val = node->getVal();
-    // Calculate common prefix of val and value.
-    size_t com_prex = 0;
-    const char* p = val.data();
-    const char* q = value.data() + position;
-    while (*p == *q && com_prex < val.size() && com_prex < remain_size) {
-      com_prex++; ++p; ++q;
-    }
-
-    if (com_prex >= kMinCommPrefix && com_prex < val.size()) {
-      // split node
-      auto new_node = std::make_unique<TrieNode>(val.substr(0, com_prex));
-      node->setVal(val.substr(com_prex));
-      new_node->addChild(std::move(node));
-      node = std::move(new_node);
-      new_nodes++;
-      if (remain_size == com_prex) {
-        return node.get();
-      } else {
-        auto new_child = std::make_unique<TrieNode>(value.substr(position + com_prex));
+  // Only children starting with the same byte as the remaining value can share
+  // a prefix with it, and a child with an empty value fully matches any value,
+  // so those are the only candidates worth comparing.
+  const int key = indexKey(value.data() + position, remain_size);
+  ChildKey* index_end = child_index_ + num_children_;
+  for (int k : {key, kEmptyKey}) {
+    ChildKey* it = std::lower_bound(
+        child_index_, index_end, k,
+        [](const ChildKey& e, int k) { return e.key < k; });
+    for (; it != index_end && it->key == k; ++it) {
+      TrieNode*& node = children_[it->slot];
+      const char* val = node->value_;
+      size_t val_size = node->value_size_;
+      // Calculate common prefix of val and value.
+      size_t com_prex = CommonPrefixLength(val, value.data() + position,
+                                           std::min(val_size, remain_size));
+
+      if (com_prex >= kMinCommPrefix && com_prex < val_size) {
+        // split node, both halves keep pointing into the existing value bytes.
+        TrieNode* new_node = wrap(arena, val, com_prex);
+        node->value_ += com_prex;
+        node->value_size_ -= com_prex;
+        new_node->addChild(arena, node);
+        node = new_node;
         new_nodes++;
-        new_value_size += remain_size - com_prex;
-        return node->addChild(std::move(new_child));
+        if (remain_size == com_prex) {
+          return node;
+        } else {
+          TrieNode* new_child = create(arena, value.data() + position + com_prex,
+                                       remain_size - com_prex);
+          new_nodes++;
+          new_value_size += remain_size - com_prex;
+          return node->addChild(arena, new_child);
+        }
       }
-    }
-    if (com_prex == val.size()) {
-      // fully matched node
-      if (remain_size == val.size()) {
-        // exact match
-        return node.get();
-      } else {
-        if (best_fully_matched_node == nullptr || val.size() > best_fully_matched_node->getVal().size())
-          best_fully_matched_node = node.get();
+      if (com_prex == val_size) {
+        // fully matched node
+        if (remain_size == val_size) {
+          // exact match
+          return node;
+        } else {
+          if (best_fully_matched_node == nullptr || val_size > best_fully_matched_node->value_size_)
+            best_fully_matched_node = node;
+        }
       }
     }
+    if (k == kEmptyKey) break;
   }
   if (best_fully_matched_node != nullptr) {
-    size_t new_position = position + best_fully_matched_node->getVal().size();
-    return best_fully_matched_node->add(value, new_position, new_nodes, new_value_size);
+    size_t new_position = position + best_fully_matched_node->value_size_;
+    return best_fully_matched_node->add(arena, value, new_position, new_nodes, new_value_size);
   }
 
   // Base case: no match
-  children_.emplace_back(std::make_unique<TrieNode>(value.substr(position)));
   new_nodes++;
   new_value_size += remain_size;
-  return children_.back().get();
+  return addChild(arena, create(arena, value.data() + position, remain_size));
 }
 
 void TrieNode::print(std::ostream &out, size_t level) const {
-  out << std::string(level * 2, ' ') << level << ": " << value_ << std::endl;
-  for (auto& c : children_) {
-    c->print(out, level + 1);
+  out << std::string(level * 2, ' ') << level << ": ";
+  out.write(value_, value_size_) << std::endl;
+  for (uint32_t i = 0; i < num_children_; ++i) {
+    children_[i]->print(out, level + 1);
   }
 }
 
-TrieNode* TrieNode::addChild(std::unique_ptr<TrieNode> child) {
-  children_.push_back(std::move(child));
-  return children_.back().get();
+TrieNode* TrieNode::addChild(Arena* arena, TrieNode* child) {
+  if (num_children_ == capacity_) {
+    // Out of room, move both lists to bigger arrays in the arena. The old
+    // arrays are simply abandoned until the arena is reset.
+    uint32_t capacity = capacity_ * 2;
+    TrieNode** children = reinterpret_cast<TrieNode**>(
+        arena->AllocateAligned(capacity * sizeof(TrieNode*)));
+    ChildKey* child_index = reinterpret_cast<ChildKey*>(
+        arena->AllocateAligned(capacity * sizeof(ChildKey)));
+    std::copy(children_, children_ + num_children_, children);
+    std::copy(child_index_, child_index_ + num_children_, child_index);
+    children_ = children;
+    child_index_ = child_index;
+    capacity_ = capacity;
+  }
+  // Keep child_index_ sorted, children sharing a first byte stay in insertion
+  // order so add() visits them in the same order as children_.
+  ChildKey entry{indexKey(child->value_, child->value_size_), num_children_};
+  ChildKey* index_end = child_index_ + num_children_;
+  ChildKey* pos = std::upper_bound(
+      child_index_, index_end, entry,
+      [](const ChildKey& a, const ChildKey& b) { return a.key < b.key; });
+  std::copy_backward(pos, index_end, index_end + 1);
+  *pos = entry;
+  children_[num_children_++] = child;
+  return child;
 }
 
 
-void TrieNode::serialize(std::string* buf, size_t parent_pos) {
+void TrieNode::serialize(std::string* buf, size_t parent_pos, bool child_index) {
   position_ = buf->size();
-  PutVarint32Varint32(buf, parent_pos, value_.size());
-  buf->append(value_);
-  for (auto& c : children_) {
-    c->serialize(buf, position_);
+  PutVarint32Varint32(buf, parent_pos, value_size_);
+  buf->append(value_, value_size_);
+  if (!child_index) {
+    for (uint32_t i = 0; i < num_children_; ++i) {
+      children_[i]->serialize(buf, position_, false);
+    }
+    return;
+  }
+  // child positions are only known once they are serialized, reserve room
+  // and fill it in afterwards.
+  PutVarint32(buf, num_children_);
+  size_t slots = buf->size();
+  buf->append(num_children_ * sizeof(uint32_t), '\0');
+  for (uint32_t i = 0; i < num_children_; ++i) {
+    children_[i]->serialize(buf, position_, true);
+    EncodeFixed32(&(*buf)[slots + i * sizeof(uint32_t)], children_[i]->position_);
   }
 }
 
 TriePosition Trie::add(const std::string& value) {
-  TrieNode* node = root_.add(value, 0, num_nodes_, node_value_size_);
+  TrieNode* node = root_->add(&arena_, value, 0, num_nodes_, node_value_size_);
   return TriePosition{node};
 }
 
@@ -95,12 +169,12 @@ void Trie::add(const std::vector<std::string>& values) {
 }
 
 std::ostream& operator<< (std::ostream &out, const Trie &trie) {
-  trie.root_.print(out, 0);
+  trie.root_->print(out, 0);
   return out;
 }
 
-void Trie::serialize(std::string* buf) {
-  root_.serialize(buf, 0);
+void Trie::serialize(std::string* buf, bool child_index) {
+  root_->serialize(buf, 0, child_index);
 }
 
 }  // namespace stbe
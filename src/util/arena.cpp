@@ -0,0 +1,88 @@
+//  Copyright (c) 2011-present, Facebook, Inc.  All rights reserved.
+//  This source code is licensed under both the GPLv2 (found in the
+//  COPYING file in the root directory) and Apache 2.0 License
+//  (found in the LICENSE.Apache file in the root directory).
+//
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/arena.h"
+
+static const int kAlignUnit = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+
+Arena::Arena(size_t block_size) : block_size_(block_size) {
+  assert(block_size_ >= static_cast<size_t>(kAlignUnit));
+}
+
+Arena::~Arena() {
+  for (char* block : blocks_) {
+    delete[] block;
+  }
+  for (char* block : large_blocks_) {
+    delete[] block;
+  }
+}
+
+void Arena::Reset() {
+  for (char* block : large_blocks_) {
+    delete[] block;
+  }
+  large_blocks_.clear();
+  memory_usage_ = blocks_.size() * (block_size_ + sizeof(char*));
+  next_block_ = 0;
+  alloc_ptr_ = nullptr;
+  alloc_bytes_remaining_ = 0;
+}
+
+char* Arena::AllocateFallback(size_t bytes) {
+  if (bytes > block_size_ / 4) {
+    // Object is more than a quarter of our block size.  Allocate it separately
+    // to avoid wasting too much space in leftover bytes.
+    char* result = new char[bytes];
+    large_blocks_.push_back(result);
+    memory_usage_ += bytes + sizeof(char*);
+    return result;
+  }
+
+  // We waste the remaining space in the current block.
+  if (next_block_ < blocks_.size()) {
+    alloc_ptr_ = blocks_[next_block_];
+  } else {
+    alloc_ptr_ = AllocateNewBlock(block_size_);
+  }
+  ++next_block_;
+  alloc_bytes_remaining_ = block_size_;
+
+  char* result = alloc_ptr_;
+  alloc_ptr_ += bytes;
+  alloc_bytes_remaining_ -= bytes;
+  return result;
+}
+
+char* Arena::AllocateAligned(size_t bytes) {
+  static_assert((kAlignUnit & (kAlignUnit - 1)) == 0,
+                "Pointer size should be a power of 2");
+  size_t current_mod =
+      reinterpret_cast<uintptr_t>(alloc_ptr_) & (kAlignUnit - 1);
+  size_t slop = (current_mod == 0 ? 0 : kAlignUnit - current_mod);
+  size_t needed = bytes + slop;
+  char* result;
+  if (needed <= alloc_bytes_remaining_) {
+    result = alloc_ptr_ + slop;
+    alloc_ptr_ += needed;
+    alloc_bytes_remaining_ -= needed;
+  } else {
+    // AllocateFallback always returned aligned memory
+    result = AllocateFallback(bytes);
+  }
+  assert((reinterpret_cast<uintptr_t>(result) & (kAlignUnit - 1)) == 0);
+  return result;
+}
+
+char* Arena::AllocateNewBlock(size_t block_bytes) {
+  char* result = new char[block_bytes];
+  blocks_.push_back(result);
+  memory_usage_ += block_bytes + sizeof(char*);
+  return result;
+}
@@ -10,6 +10,12 @@
 #include "util/coding.h"
 
 #include <algorithm>
+#include <array>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STBE_X86_SIMD 1
+#endif
 
 
 // conversion' conversion from 'type1' to 'type2', possible loss of data
@@ -82,3 +88,253 @@ const char* GetVarint64Ptr(const char* p, const char* limit, uint64_t* value) {
   }
   return nullptr;
 }
+
+namespace {
+
+typedef const char* (*SkipVarintsFn)(const char* p, const char* limit, size_t n);
+
+// Returns the position of the n-th (from 1) set bit of mask, which has at
+// least n bits set.
+inline int NthSetBit(uint64_t mask, size_t n) {
+  for (; n > 1; --n) {
+    mask &= mask - 1;
+  }
+  return __builtin_ctzll(mask);
+}
+
+// Handles whatever is left after the vector loops: 8 bytes at a time, then
+// byte by byte.
+inline const char* SkipVarintsTail(const char* p, const char* limit, size_t n) {
+  if (n == 0) return p;
+  if (port::kLittleEndian) {
+    for (; limit - p >= 8; p += 8) {
+      uint64_t x;
+      memcpy(&x, p, sizeof(x));
+      // high bits of the bytes ending a varint.
+      uint64_t ends = ~x & 0x8080808080808080ull;
+      size_t count = __builtin_popcountll(ends);
+      if (count >= n) return p + (NthSetBit(ends, n) >> 3) + 1;
+      n -= count;
+    }
+  }
+  for (; p < limit; ++p) {
+    if ((*p & 0x80) == 0 && --n == 0) return p + 1;
+  }
+  return nullptr;
+}
+
+#ifdef STBE_X86_SIMD
+const char* SkipVarintsSSE2(const char* p, const char* limit, size_t n) {
+  for (; n > 0 && limit - p >= 16; p += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    uint32_t ends = ~static_cast<uint32_t>(_mm_movemask_epi8(x)) & 0xFFFF;
+    size_t count = __builtin_popcount(ends);
+    if (count >= n) return p + NthSetBit(ends, n) + 1;
+    n -= count;
+  }
+  return SkipVarintsTail(p, limit, n);
+}
+
+__attribute__((target("avx2,popcnt")))
+const char* SkipVarintsAVX2(const char* p, const char* limit, size_t n) {
+  for (; n > 0 && limit - p >= 32; p += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+    uint32_t ends = ~static_cast<uint32_t>(_mm256_movemask_epi8(x));
+    size_t count = __builtin_popcount(ends);
+    if (count >= n) return p + NthSetBit(ends, n) + 1;
+    n -= count;
+  }
+  return SkipVarintsSSE2(p, limit, n);
+}
+#endif
+
+const char* SkipVarintsResolve(const char* p, const char* limit, size_t n);
+
+// Starts out pointing at the resolver, which replaces it with the best
+// implementation for this CPU on first use.
+SkipVarintsFn skip_varints_impl = SkipVarintsResolve;
+
+const char* SkipVarintsResolve(const char* p, const char* limit, size_t n) {
+  SkipVarintsFn impl = SkipVarintsScalar;
+#ifdef STBE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+    impl = SkipVarintsAVX2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    impl = SkipVarintsSSE2;
+  }
+#endif
+  __atomic_store_n(&skip_varints_impl, impl, __ATOMIC_RELAXED);
+  return impl(p, limit, n);
+}
+
+}  // namespace
+
+const char* SkipVarintsScalar(const char* p, const char* limit, size_t n) {
+  return SkipVarintsTail(p, limit, n);
+}
+
+const char* SkipVarints(const char* p, const char* limit, size_t n) {
+  return __atomic_load_n(&skip_varints_impl, __ATOMIC_RELAXED)(p, limit, n);
+}
+
+namespace {
+
+typedef const char* (*GetVarint32BatchFn)(const char* p, const char* limit,
+                                          uint32_t* values, size_t n);
+
+inline const char* GetVarint32BatchTail(const char* p, const char* limit,
+                                        uint32_t* values, size_t n) {
+  for (size_t i = 0; i < n; ++i) {
+    p = GetVarint32Ptr(p, limit, &values[i]);
+    if (p == nullptr) return nullptr;
+  }
+  return p;
+}
+
+#ifdef STBE_X86_SIMD
+// How to decode the varints ending in the next 8 bytes, given their
+// continuation bits: shuffle moves the bytes of the i-th varint into the
+// i-th 32-bit lane. Only the first 4 varints are taken, and none past one
+// longer than 4 bytes.
+struct VarintShuffle {
+  uint8_t shuffle[16];
+  uint8_t num_values;
+  uint8_t consumed;  // bytes of the varints taken
+};
+
+constexpr std::array<VarintShuffle, 256> MakeVarintShuffles() {
+  std::array<VarintShuffle, 256> table{};
+  for (int key = 0; key < 256; ++key) {
+    VarintShuffle& entry = table[key];
+    for (int i = 0; i < 16; ++i) {
+      entry.shuffle[i] = 0x80;  // zero the byte
+    }
+    int start = 0;
+    int num_values = 0;
+    for (int i = 0; i < 8 && num_values < 4; ++i) {
+      if (key & (1 << i)) continue;  // more bytes follow
+      int len = i - start + 1;
+      if (len > 4) break;
+      for (int b = 0; b < len; ++b) {
+        entry.shuffle[num_values * 4 + b] = start + b;
+      }
+      ++num_values;
+      start = i + 1;
+    }
+    entry.num_values = num_values;
+    entry.consumed = start;
+  }
+  return table;
+}
+
+constexpr std::array<VarintShuffle, 256> kVarintShuffles = MakeVarintShuffles();
+
+// Packs the 7-bit groups of the little endian varint bytes in each lane.
+inline __m128i CombineVarintBytes(__m128i v) {
+  __m128i r = _mm_and_si128(v, _mm_set1_epi32(0x7f));
+  r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 1), _mm_set1_epi32(0x7f << 7)));
+  r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 2), _mm_set1_epi32(0x7f << 14)));
+  return _mm_or_si128(r, _mm_and_si128(_mm_srli_epi32(v, 3), _mm_set1_epi32(0x7f << 21)));
+}
+
+__attribute__((target("avx2")))
+inline __m256i CombineVarintBytes256(__m256i v) {
+  __m256i r = _mm256_and_si256(v, _mm256_set1_epi32(0x7f));
+  r = _mm256_or_si256(r, _mm256_and_si256(_mm256_srli_epi32(v, 1), _mm256_set1_epi32(0x7f << 7)));
+  r = _mm256_or_si256(r, _mm256_and_si256(_mm256_srli_epi32(v, 2), _mm256_set1_epi32(0x7f << 14)));
+  return _mm256_or_si256(r, _mm256_and_si256(_mm256_srli_epi32(v, 3), _mm256_set1_epi32(0x7f << 21)));
+}
+
+inline const VarintShuffle& LookupVarintShuffle(__m128i data) {
+  return kVarintShuffles[_mm_movemask_epi8(data) & 0xFF];
+}
+
+__attribute__((target("ssse3")))
+const char* GetVarint32BatchSSSE3(const char* p, const char* limit,
+                                  uint32_t* values, size_t n) {
+  size_t i = 0;
+  // every step stores 4 values and loads 16 bytes.
+  while (n - i >= 4 && limit - p >= 16) {
+    __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const VarintShuffle& entry = LookupVarintShuffle(data);
+    if (entry.num_values == 0) {
+      // a varint longer than 4 bytes.
+      p = GetVarint32Ptr(p, limit, &values[i++]);
+      if (p == nullptr) return nullptr;
+      continue;
+    }
+    __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(entry.shuffle));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i),
+                     CombineVarintBytes(_mm_shuffle_epi8(data, shuffle)));
+    p += entry.consumed;
+    i += entry.num_values;
+  }
+  return GetVarint32BatchTail(p, limit, values + i, n - i);
+}
+
+__attribute__((target("avx2")))
+const char* GetVarint32BatchAVX2(const char* p, const char* limit,
+                                 uint32_t* values, size_t n) {
+  size_t i = 0;
+  // every step stores 8 values and loads 16 bytes at up to p + 8.
+  while (n - i >= 8 && limit - p >= 24) {
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const VarintShuffle& lo_entry = LookupVarintShuffle(lo);
+    if (lo_entry.num_values == 0) {
+      p = GetVarint32Ptr(p, limit, &values[i++]);
+      if (p == nullptr) return nullptr;
+      continue;
+    }
+    const char* q = p + lo_entry.consumed;
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(q));
+    const VarintShuffle& hi_entry = LookupVarintShuffle(hi);
+    __m256i shuffle = _mm256_set_m128i(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(hi_entry.shuffle)),
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(lo_entry.shuffle)));
+    __m256i r = CombineVarintBytes256(
+        _mm256_shuffle_epi8(_mm256_set_m128i(hi, lo), shuffle));
+    // the high half goes right after the values of the low one.
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), _mm256_castsi256_si128(r));
+    i += lo_entry.num_values;
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(values + i), _mm256_extracti128_si256(r, 1));
+    i += hi_entry.num_values;
+    p = q + hi_entry.consumed;
+  }
+  return GetVarint32BatchSSSE3(p, limit, values + i, n - i);
+}
+#endif
+
+const char* GetVarint32BatchResolve(const char* p, const char* limit,
+                                    uint32_t* values, size_t n);
+
+// Starts out pointing at the resolver, which replaces it with the best
+// implementation for this CPU on first use.
+GetVarint32BatchFn get_varint32_batch_impl = GetVarint32BatchResolve;
+
+const char* GetVarint32BatchResolve(const char* p, const char* limit,
+                                    uint32_t* values, size_t n) {
+  GetVarint32BatchFn impl = GetVarint32BatchScalar;
+#ifdef STBE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    impl = GetVarint32BatchAVX2;
+  } else if (__builtin_cpu_supports("ssse3")) {
+    impl = GetVarint32BatchSSSE3;
+  }
+#endif
+  __atomic_store_n(&get_varint32_batch_impl, impl, __ATOMIC_RELAXED);
+  return impl(p, limit, values, n);
+}
+
+}  // namespace
+
+const char* GetVarint32BatchScalar(const char* p, const char* limit,
+                                   uint32_t* values, size_t n) {
+  return GetVarint32BatchTail(p, limit, values, n);
+}
+
+const char* GetVarint32Batch(const char* p, const char* limit,
+                             uint32_t* values, size_t n) {
+  return __atomic_load_n(&get_varint32_batch_impl, __ATOMIC_RELAXED)(p, limit, values, n);
+}
@@ -0,0 +1,103 @@
+#include "util/common_prefix.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define STBE_X86_SIMD 1
+#endif
+
+#include "util/port.h"
+
+namespace {
+
+typedef size_t (*CommonPrefixFn)(const char* a, const char* b, size_t n);
+
+// Handles whatever is left after the vector loops: 8 bytes at a time, then
+// byte by byte.
+inline size_t CommonPrefixTail(const char* a, const char* b, size_t i,
+                               size_t n) {
+  if (port::kLittleEndian) {
+    for (; i + sizeof(uint64_t) <= n; i += sizeof(uint64_t)) {
+      uint64_t x, y;
+      memcpy(&x, a + i, sizeof(x));
+      memcpy(&y, b + i, sizeof(y));
+      if (x != y) {
+        return i + (__builtin_ctzll(x ^ y) >> 3);
+      }
+    }
+  }
+  while (i < n && a[i] == b[i]) {
+    ++i;
+  }
+  return i;
+}
+
+#ifdef STBE_X86_SIMD
+size_t CommonPrefixLengthSSE2(const char* a, const char* b, size_t n) {
+  size_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)));
+    if (mask != 0xFFFF) {
+      return i + __builtin_ctz(~mask);
+    }
+  }
+  return CommonPrefixTail(a, b, i, n);
+}
+
+__attribute__((target("avx2")))
+size_t CommonPrefixLengthAVX2(const char* a, const char* b, size_t n) {
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+    __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+    unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)));
+    if (mask != 0xFFFFFFFFu) {
+      return i + __builtin_ctz(~mask);
+    }
+  }
+  if (i + 16 <= n) {
+    __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+    __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+    unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)));
+    if (mask != 0xFFFF) {
+      return i + __builtin_ctz(~mask);
+    }
+    i += 16;
+  }
+  return CommonPrefixTail(a, b, i, n);
+}
+#endif
+
+size_t CommonPrefixLengthResolve(const char* a, const char* b, size_t n);
+
+// Starts out pointing at the resolver, which replaces it with the best
+// implementation for this CPU on first use.
+CommonPrefixFn common_prefix_impl = CommonPrefixLengthResolve;
+
+size_t CommonPrefixLengthResolve(const char* a, const char* b, size_t n) {
+  CommonPrefixFn impl = CommonPrefixLengthScalar;
+#ifdef STBE_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2")) {
+    impl = CommonPrefixLengthAVX2;
+  } else if (__builtin_cpu_supports("sse2")) {
+    impl = CommonPrefixLengthSSE2;
+  }
+#endif
+  __atomic_store_n(&common_prefix_impl, impl, __ATOMIC_RELAXED);
+  return impl(a, b, n);
+}
+
+}  // namespace
+
+size_t CommonPrefixLengthScalar(const char* a, const char* b, size_t n) {
+  return CommonPrefixTail(a, b, 0, n);
+}
+
+size_t CommonPrefixLength(const char* a, const char* b, size_t n) {
+  return __atomic_load_n(&common_prefix_impl, __ATOMIC_RELAXED)(a, b, n);
+}
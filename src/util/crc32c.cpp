@@ -0,0 +1,98 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/crc32c.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define STBE_X86_CRC32 1
+#endif
+
+namespace crc32c {
+
+namespace {
+
+typedef uint32_t (*ExtendFn)(uint32_t init_crc, const char* data, size_t n);
+
+// Castagnoli polynomial, reflected.
+constexpr uint32_t kPolynomial = 0x82f63b78u;
+
+struct Table {
+  uint32_t entries[256];
+  constexpr Table() : entries() {
+    for (uint32_t i = 0; i < 256; ++i) {
+      uint32_t crc = i;
+      for (int k = 0; k < 8; ++k) {
+        crc = (crc >> 1) ^ ((crc & 1) ? kPolynomial : 0);
+      }
+      entries[i] = crc;
+    }
+  }
+};
+constexpr Table kTable;
+
+#ifdef STBE_X86_CRC32
+__attribute__((target("sse4.2")))
+uint32_t ExtendSSE42(uint32_t init_crc, const char* data, size_t n) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  const unsigned char* e = p + n;
+#if defined(__x86_64__)
+  uint64_t l = init_crc ^ 0xffffffffu;
+  for (; e - p >= 8; p += 8) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    l = _mm_crc32_u64(l, word);
+  }
+  uint32_t crc = static_cast<uint32_t>(l);
+#else
+  uint32_t crc = init_crc ^ 0xffffffffu;
+#endif
+  for (; e - p >= 4; p += 4) {
+    uint32_t word;
+    memcpy(&word, p, sizeof(word));
+    crc = _mm_crc32_u32(crc, word);
+  }
+  for (; p != e; ++p) {
+    crc = _mm_crc32_u8(crc, *p);
+  }
+  return crc ^ 0xffffffffu;
+}
+#endif
+
+uint32_t ExtendResolve(uint32_t init_crc, const char* data, size_t n);
+
+// Starts out pointing at the resolver, which replaces it with the best
+// implementation for this CPU on first use.
+ExtendFn extend_impl = ExtendResolve;
+
+uint32_t ExtendResolve(uint32_t init_crc, const char* data, size_t n) {
+  ExtendFn impl = ExtendPortable;
+#ifdef STBE_X86_CRC32
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) {
+    impl = ExtendSSE42;
+  }
+#endif
+  __atomic_store_n(&extend_impl, impl, __ATOMIC_RELAXED);
+  return impl(init_crc, data, n);
+}
+
+}  // namespace
+
+uint32_t ExtendPortable(uint32_t init_crc, const char* data, size_t n) {
+  const unsigned char* p = reinterpret_cast<const unsigned char*>(data);
+  uint32_t crc = init_crc ^ 0xffffffffu;
+  for (size_t i = 0; i < n; ++i) {
+    crc = kTable.entries[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc ^ 0xffffffffu;
+}
+
+uint32_t Extend(uint32_t init_crc, const char* data, size_t n) {
+  return __atomic_load_n(&extend_impl, __ATOMIC_RELAXED)(init_crc, data, n);
+}
+
+}  // namespace crc32c
@@ -0,0 +1,139 @@
+#include "util/lz.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "util/coding.h"
+#include "util/common_prefix.h"
+
+namespace lz {
+
+namespace {
+
+constexpr size_t kMinMatch = 4;
+constexpr size_t kMaxOffset = 65535;
+constexpr int kHashBits = 14;
+constexpr size_t kMaxLength = 15;  // fits in a token nibble
+
+inline uint32_t Load32(const char* p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+inline uint32_t Hash(uint32_t v) {
+  return (v * 2654435761u) >> (32 - kHashBits);
+}
+
+void PutLength(std::string* output, size_t len) {
+  len -= kMaxLength;
+  for (; len >= 255; len -= 255) {
+    output->push_back(static_cast<char>(255));
+  }
+  output->push_back(static_cast<char>(len));
+}
+
+bool GetLength(const char** p, const char* limit, size_t* len) {
+  uint8_t b;
+  do {
+    if (*p == limit) return false;
+    b = static_cast<uint8_t>(*(*p)++);
+    *len += b;
+  } while (b == 255);
+  return true;
+}
+
+// match_len == 0 emits the last, literals only, sequence.
+void PutSequence(std::string* output, const char* literals, size_t literal_len,
+                 size_t offset, size_t match_len) {
+  size_t match_code = match_len == 0 ? 0 : match_len - kMinMatch;
+  output->push_back(static_cast<char>(
+      (std::min(literal_len, kMaxLength) << 4) | std::min(match_code, kMaxLength)));
+  if (literal_len >= kMaxLength) PutLength(output, literal_len);
+  output->append(literals, literal_len);
+  if (match_len == 0) return;
+  PutFixed16(output, static_cast<uint16_t>(offset));
+  if (match_code >= kMaxLength) PutLength(output, match_code);
+}
+
+}  // namespace
+
+void Compress(const char* input, size_t n, std::string* output) {
+  PutVarint32(output, static_cast<uint32_t>(n));
+  size_t anchor = 0;  // start of the pending literals
+  if (n > kMinMatch) {
+    // last position in table of each hashed 4 bytes.
+    std::vector<uint32_t> table(1 << kHashBits, 0);
+    const size_t last = n - kMinMatch;
+    size_t pos = 1;  // table starts out pointing at position 0
+    while (pos <= last) {
+      uint32_t v = Load32(input + pos);
+      uint32_t h = Hash(v);
+      size_t candidate = table[h];
+      table[h] = static_cast<uint32_t>(pos);
+      if (pos - candidate > kMaxOffset || Load32(input + candidate) != v) {
+        // step faster through data that does not compress.
+        pos += 1 + ((pos - anchor) >> 6);
+        continue;
+      }
+      size_t len = kMinMatch + CommonPrefixLength(input + candidate + kMinMatch,
+                                                  input + pos + kMinMatch,
+                                                  n - pos - kMinMatch);
+      PutSequence(output, input + anchor, pos - anchor, pos - candidate, len);
+      pos += len;
+      anchor = pos;
+      // index the tail of the match so the next one can start right there.
+      if (pos <= last) table[Hash(Load32(input + pos - 1))] = pos - 1;
+    }
+  }
+  PutSequence(output, input + anchor, n - anchor, 0, 0);
+}
+
+bool Uncompress(const char* input, size_t n, std::string* output) {
+  const char* p = input;
+  const char* limit = input + n;
+  uint32_t raw_len;
+  p = GetVarint32Ptr(p, limit, &raw_len);
+  // a byte of input expands to at most 255 bytes.
+  if (p == nullptr || raw_len / 255 > n) return false;
+  output->resize(raw_len);
+  char* out = &(*output)[0];
+  size_t op = 0;
+  while (p < limit) {
+    uint8_t token = static_cast<uint8_t>(*p++);
+    size_t literal_len = token >> 4;
+    if (literal_len == kMaxLength && !GetLength(&p, limit, &literal_len)) {
+      return false;
+    }
+    if (literal_len > static_cast<size_t>(limit - p) || literal_len > raw_len - op) {
+      return false;
+    }
+    memcpy(out + op, p, literal_len);
+    op += literal_len;
+    p += literal_len;
+    if (p == limit) break;  // the last sequence
+
+    if (limit - p < 2) return false;
+    size_t offset = DecodeFixed16(p);
+    p += 2;
+    size_t match_len = token & 0xf;
+    if (match_len == kMaxLength && !GetLength(&p, limit, &match_len)) {
+      return false;
+    }
+    match_len += kMinMatch;
+    if (offset == 0 || offset > op || match_len > raw_len - op) return false;
+    const char* src = out + op - offset;
+    if (offset >= match_len) {
+      memcpy(out + op, src, match_len);
+    } else {
+      // overlapping match repeats the last offset bytes.
+      for (size_t i = 0; i < match_len; ++i) out[op + i] = src[i];
+    }
+    op += match_len;
+  }
+  return op == raw_len;
+}
+
+}  // namespace lz
@@ -0,0 +1,69 @@
+#include "util/mmap_file.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MmapFile::~MmapFile() {
+  Close();
+}
+
+bool MmapFile::Open(const std::string& fname, const Options& options) {
+  Close();
+  int fd = open(fname.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return false;
+  }
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if (options.populate) flags |= MAP_POPULATE;
+#endif
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+  // the mapping stays valid after the descriptor is closed.
+  close(fd);
+  if (addr == MAP_FAILED) return false;
+  data_ = static_cast<const char*>(addr);
+  size_ = st.st_size;
+
+#ifdef MADV_HUGEPAGE
+  if (options.huge_pages) {
+    // only a hint, not all kernels or file systems support it.
+    madvise(addr, size_, MADV_HUGEPAGE);
+  }
+#endif
+  if (options.advice != kNormal) Advise(options.advice);
+  return true;
+}
+
+void MmapFile::Close() {
+  if (data_ != nullptr) {
+    munmap(const_cast<char*>(data_), size_);
+    data_ = nullptr;
+    size_ = 0;
+  }
+}
+
+bool MmapFile::Advise(Advice advice) const {
+  return Advise(0, size_, advice);
+}
+
+bool MmapFile::Advise(size_t offset, size_t len, Advice advice) const {
+  if (data_ == nullptr || offset >= size_) return false;
+  // madvise() takes whole pages, the mapping itself starts at one.
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  size_t begin = offset - offset % page_size;
+  len = std::min(len, size_ - offset) + (offset - begin);
+  int advice_flag = MADV_NORMAL;
+  switch (advice) {
+    case kNormal: advice_flag = MADV_NORMAL; break;
+    case kSequential: advice_flag = MADV_SEQUENTIAL; break;
+    case kRandom: advice_flag = MADV_RANDOM; break;
+    case kWillNeed: advice_flag = MADV_WILLNEED; break;
+  }
+  return madvise(const_cast<char*>(data_) + begin, len, advice_flag) == 0;
+}
@@ -0,0 +1,89 @@
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "block_cache.h"
+#include "stbe.h"
+#include "test_util.h"
+
+namespace stbe {
+
+TEST(BlockCacheTest, LookupAndEvict)
+{
+  BlockCache cache(300, 0);  // single shard, room for 3 blocks of 100 bytes
+  uint64_t file = BlockCache::newFileId();
+  EXPECT_EQ(nullptr, cache.lookup(file, 0));
+  BlockCache::Handle pinned = cache.insert(file, 0, std::string(100, 'a'));
+  cache.insert(file, 1, std::string(100, 'b'));
+  cache.insert(file, 2, std::string(100, 'c'));
+  ASSERT_NE(nullptr, cache.lookup(file, 1));  // leaves 0 least recently used
+  cache.insert(file, 3, std::string(100, 'd'));  // evicts 0
+
+  EXPECT_EQ(nullptr, cache.lookup(file, 0));
+  EXPECT_EQ(std::string(100, 'a'), *pinned) << "Handle outlives eviction.";
+  EXPECT_EQ(std::string(100, 'b'), *cache.lookup(file, 1));
+  EXPECT_EQ(nullptr, cache.lookup(BlockCache::newFileId(), 1));
+
+  BlockCache::Stats stats = cache.stats();
+  EXPECT_EQ(2u, stats.hits);
+  EXPECT_EQ(3u, stats.misses);
+  EXPECT_EQ(1u, stats.evictions);
+  EXPECT_EQ(300u, stats.usage);
+}
+
+TEST(BlockCacheTest, CapacityIsGlobal)
+{
+  // 4 shards, blocks larger than a shard's share of the capacity.
+  BlockCache cache(1000, 2);
+  uint64_t file = BlockCache::newFileId();
+  for (uint64_t offset = 0; offset < 40; ++offset) {
+    cache.insert(file, offset, std::string(300, 'a'));
+    EXPECT_LE(cache.stats().usage, 1000u) << offset;
+  }
+  EXPECT_EQ(900u, cache.stats().usage);
+  ASSERT_NE(nullptr, cache.lookup(file, 39));
+
+  // a block beyond the whole capacity is not kept.
+  BlockCache::Handle handle = cache.insert(file, 40, std::string(2000, 'b'));
+  EXPECT_EQ(std::string(2000, 'b'), *handle);
+  EXPECT_EQ(nullptr, cache.lookup(file, 40));
+  EXPECT_EQ(900u, cache.stats().usage);
+}
+
+TEST(BlockCacheTest, SharedByDecoders)
+{
+  TempFile tmp("block_cache_test_file");
+  std::vector<std::string> input;
+  for (int i = 0; i < 100; ++i) {
+    input.push_back("/images/" + std::to_string(i * 7919) + ".gif");
+  }
+  Builder<std::string> builder(64);
+  builder.initialize(tmp.path());
+  builder.add(input);
+  builder.finalize();
+
+  DecoderOptions options;
+  options.block_cache = std::make_shared<BlockCache>(1 << 20);
+  Decoder<std::string> d1(tmp.path(), options);
+  Decoder<std::string> d2(tmp.path(), options);
+  // alternate between the first and the last block.
+  for (int round = 0; round < 10; ++round) {
+    EXPECT_EQ(input.front(), d1[0]);
+    EXPECT_EQ(input.back(), d1[input.size() - 1]);
+    EXPECT_EQ(input[1], d2[1]);
+    EXPECT_EQ(input[input.size() - 2], d2[input.size() - 2]);
+  }
+  BlockCache::Stats stats = options.block_cache->stats();
+  // d1 and d2 each opened the file, so they do not share blocks.
+  EXPECT_EQ(4u, stats.misses) << "Every block is read once per FileHandle.";
+  EXPECT_EQ(0u, stats.evictions);
+
+  // a Cursor on d1's FileHandle finds d1's blocks cached.
+  Cursor<std::string> cursor(d1.file());
+  EXPECT_EQ(input.front(), cursor[0]);
+  EXPECT_EQ(input.back(), cursor[input.size() - 1]);
+  EXPECT_EQ(4u, options.block_cache->stats().misses);
+}
+
+}  // namespace stbe
@@ -0,0 +1,50 @@
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/bloom.h"
+
+namespace {
+
+uint32_t hashOf(const std::string& key) {
+  return BloomHash(key.data(), key.size());
+}
+
+std::string buildFilter(int n, int bits_per_key) {
+  std::vector<uint32_t> hashes;
+  for (int i = 0; i < n; ++i) {
+    hashes.push_back(hashOf("key" + std::to_string(i)));
+  }
+  std::string filter;
+  BuildBloomFilter(hashes.data(), hashes.size(), bits_per_key, &filter);
+  return filter;
+}
+
+}  // namespace
+
+TEST(BloomTest, EmptyFilter)
+{
+  std::string filter = buildFilter(0, 10);
+  EXPECT_FALSE(BloomMayMatch(hashOf("hello"), filter.data(), filter.size()));
+  EXPECT_FALSE(BloomMayMatch(hashOf("world"), filter.data(), filter.size()));
+}
+
+TEST(BloomTest, VaryingLengths)
+{
+  for (int n : {1, 10, 100, 1000, 10000}) {
+    std::string filter = buildFilter(n, 10);
+    EXPECT_LE(filter.size(), static_cast<size_t>(n * 10 / 8 + 40)) << n;
+    // all added keys match.
+    for (int i = 0; i < n; ++i) {
+      EXPECT_TRUE(BloomMayMatch(hashOf("key" + std::to_string(i)),
+                                filter.data(), filter.size())) << i;
+    }
+    // and about 1% of the others.
+    int false_positives = 0;
+    for (int i = 0; i < 10000; ++i) {
+      false_positives += BloomMayMatch(hashOf("other" + std::to_string(i)),
+                                       filter.data(), filter.size());
+    }
+    EXPECT_LE(false_positives, 200) << n;
+  }
+}
@@ -0,0 +1,89 @@
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/coding.h"
+
+namespace {
+
+// Varints of mixed lengths, ends[i] is the offset just past the i-th.
+std::string randomVarints(size_t n, uint32_t seed, std::vector<size_t>* ends) {
+  std::mt19937 rnd(seed);
+  std::string buf;
+  for (size_t i = 0; i < n; ++i) {
+    uint32_t bits = rnd() % 33;
+    PutVarint32(&buf, bits == 0 ? 0 : static_cast<uint32_t>(rnd()) >> (32 - bits));
+    ends->push_back(buf.size());
+  }
+  return buf;
+}
+
+}  // namespace
+
+TEST(CodingTest, SkipVarints)
+{
+  std::vector<size_t> ends;
+  std::string buf = randomVarints(2000, 301, &ends);
+  const char* p = buf.data();
+  const char* limit = p + buf.size();
+  for (size_t start : {0, 1, 7, 100}) {
+    const char* begin = start == 0 ? p : p + ends[start - 1];
+    for (size_t n = 0; start + n < ends.size(); n += 1 + n / 8) {
+      const char* expected = n == 0 ? begin : p + ends[start + n - 1];
+      EXPECT_EQ(expected, SkipVarints(begin, limit, n)) << start << " " << n;
+      EXPECT_EQ(expected, SkipVarintsScalar(begin, limit, n)) << start << " " << n;
+    }
+    EXPECT_EQ(limit, SkipVarints(begin, limit, ends.size() - start));
+    EXPECT_EQ(nullptr, SkipVarints(begin, limit, ends.size() - start + 1));
+  }
+
+  // a truncated last varint does not count.
+  std::string truncated = buf.substr(0, ends.back() - 1);
+  if (ends.back() - ends[ends.size() - 2] > 1) {
+    EXPECT_EQ(nullptr, SkipVarints(truncated.data(), truncated.data() + truncated.size(),
+                                   ends.size()));
+  }
+  EXPECT_EQ(nullptr, SkipVarints(p, p, 1));
+  EXPECT_EQ(p, SkipVarints(p, p, 0));
+}
+
+TEST(CodingTest, GetVarint32Batch)
+{
+  std::vector<size_t> ends;
+  std::string buf = randomVarints(2000, 302, &ends);
+  // and a run of short ones, the common case of node positions.
+  std::mt19937 rnd(303);
+  for (size_t i = 0; i < 2000; ++i) {
+    PutVarint32(&buf, rnd() % (1u << (7 * (1 + i % 3))));
+    ends.push_back(buf.size());
+  }
+  std::vector<uint32_t> expected(ends.size());
+  const char* p = buf.data();
+  const char* limit = p + buf.size();
+  for (size_t i = 0; i < ends.size(); ++i) {
+    p = GetVarint32Ptr(p, limit, &expected[i]);
+  }
+  p = buf.data();
+  for (size_t start : {0, 1, 7, 1999, 2000, 2003}) {
+    const char* begin = start == 0 ? p : p + ends[start - 1];
+    for (size_t n = 0; start + n <= ends.size(); n += 1 + n / 4) {
+      const char* end = n == 0 ? begin : p + ends[start + n - 1];
+      std::vector<uint32_t> values(n), scalar(n);
+      ASSERT_EQ(end, GetVarint32Batch(begin, limit, values.data(), n)) << start << " " << n;
+      ASSERT_EQ(end, GetVarint32BatchScalar(begin, limit, scalar.data(), n));
+      EXPECT_TRUE(std::equal(values.begin(), values.end(), expected.begin() + start))
+          << start << " " << n;
+      EXPECT_EQ(values, scalar);
+    }
+    std::vector<uint32_t> values(ends.size() - start + 1);
+    EXPECT_EQ(nullptr, GetVarint32Batch(begin, limit, values.data(), values.size()));
+  }
+
+  // more than 5 bytes is malformed.
+  std::string bad(32, '\x80');
+  std::vector<uint32_t> values(16);
+  EXPECT_EQ(nullptr, GetVarint32Batch(bad.data(), bad.data() + bad.size(),
+                                      values.data(), values.size()));
+}
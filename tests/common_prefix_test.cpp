@@ -0,0 +1,33 @@
+#include <string>
+
+#include "gtest/gtest.h"
+#include "util/common_prefix.h"
+
+namespace stbe {
+
+TEST(CommonPrefixTest, MismatchAtEveryOffset)
+{
+  // Lengths cover the AVX2, SSE2, 8-byte and byte-by-byte paths.
+  for (size_t len : {0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 100}) {
+    std::string a(len, 'x');
+    for (size_t i = 0; i < len; ++i) a[i] = static_cast<char>('a' + i % 26);
+    EXPECT_EQ(len, CommonPrefixLength(a.data(), a.data(), len));
+    EXPECT_EQ(len, CommonPrefixLengthScalar(a.data(), a.data(), len));
+    for (size_t diff = 0; diff < len; ++diff) {
+      std::string b = a;
+      b[diff] = '\xff';
+      EXPECT_EQ(diff, CommonPrefixLength(a.data(), b.data(), len)) << len;
+      EXPECT_EQ(diff, CommonPrefixLengthScalar(a.data(), b.data(), len)) << len;
+    }
+  }
+}
+
+TEST(CommonPrefixTest, StopsAtLength)
+{
+  std::string a = "/images/logos/nasa-logo.gif";
+  std::string b = "/images/logos/nasa-logo.gif?x";
+  EXPECT_EQ(14u, CommonPrefixLength(a.data(), b.data(), 14));
+  EXPECT_EQ(a.size(), CommonPrefixLength(a.data(), b.data(), a.size()));
+}
+
+}  // namespace stbe
@@ -0,0 +1,93 @@
+#include <algorithm>
+#include <random>
+#include <string>
+
+#include "compression.h"
+#include "gtest/gtest.h"
+#include "util/lz.h"
+
+namespace stbe {
+
+namespace {
+std::string roundTrip(const std::string& input) {
+  std::string compressed;
+  lz::Compress(input.data(), input.size(), &compressed);
+  std::string output;
+  EXPECT_TRUE(lz::Uncompress(compressed.data(), compressed.size(), &output));
+  return output;
+}
+}  // namespace
+
+TEST(LZTest, RoundTrip)
+{
+  std::mt19937 rnd(301);
+  std::string random;
+  for (int i = 0; i < 100000; ++i) random.push_back(static_cast<char>(rnd()));
+  std::string text;
+  while (text.size() < 100000) {
+    text += "GET /shuttle/missions/sts-" + std::to_string(rnd() % 80) + "/mission.html\n";
+  }
+
+  for (const std::string& input : {std::string(), std::string("a"),
+                                   std::string("abcd"), std::string(100000, 'x'),
+                                   std::string("abcabcabcabcabcabc"), random, text}) {
+    EXPECT_TRUE(input == roundTrip(input)) << input.size();
+  }
+
+  std::string compressed;
+  lz::Compress(text.data(), text.size(), &compressed);
+  EXPECT_LT(compressed.size(), text.size() / 3);
+}
+
+TEST(LZTest, Corrupt)
+{
+  std::string text;
+  for (int i = 0; i < 1000; ++i) text += "/images/NASA-logosmall.gif " + std::to_string(i);
+  std::string compressed;
+  lz::Compress(text.data(), text.size(), &compressed);
+  std::string output;
+  // any truncation is detected.
+  for (size_t n = 0; n < compressed.size(); ++n) {
+    EXPECT_FALSE(lz::Uncompress(compressed.data(), n, &output)) << n;
+  }
+  // garbage never reads or writes out of bounds.
+  std::mt19937 rnd(7);
+  for (int i = 0; i < 1000; ++i) {
+    std::string corrupt = compressed;
+    corrupt[rnd() % corrupt.size()] ^= static_cast<char>(1 + rnd() % 255);
+    lz::Uncompress(corrupt.data(), corrupt.size(), &output);
+  }
+}
+
+namespace {
+class ReverseCodec : public Codec {
+public:
+  uint8_t id() const override { return kFirstUserCodec; }
+  const char* name() const override { return "reverse"; }
+  bool compress(const char* input, size_t n, std::string* output) const override {
+    output->append(std::string(input, n).rbegin(), std::string(input, n).rend());
+    return true;
+  }
+  bool uncompress(const char* input, size_t n, std::string* output) const override {
+    output->assign(input, n);
+    std::reverse(output->begin(), output->end());
+    return true;
+  }
+};
+}  // namespace
+
+TEST(CodecTest, Registry)
+{
+  const Codec* lz_codec = getCodec(kLZCompression);
+  ASSERT_NE(nullptr, lz_codec);
+  EXPECT_EQ(kLZCompression, lz_codec->id());
+  EXPECT_EQ(nullptr, getCodec(kNoCompression));
+  EXPECT_EQ(nullptr, getCodec(kFirstUserCodec));
+
+  static ReverseCodec reverse;
+  EXPECT_TRUE(registerCodec(&reverse));
+  EXPECT_EQ(&reverse, getCodec(kFirstUserCodec));
+  EXPECT_FALSE(registerCodec(&reverse));  // id taken
+}
+
+}  // namespace stbe
@@ -0,0 +1,52 @@
+#include <string>
+
+#include "gtest/gtest.h"
+#include "util/crc32c.h"
+
+namespace crc32c {
+
+TEST(CRC, StandardResults)
+{
+  // From rfc3720 section B.4.
+  char buf[32];
+
+  memset(buf, 0, sizeof(buf));
+  EXPECT_EQ(0x8a9136aau, Value(buf, sizeof(buf)));
+  EXPECT_EQ(0x8a9136aau, ExtendPortable(0, buf, sizeof(buf)));
+
+  memset(buf, 0xff, sizeof(buf));
+  EXPECT_EQ(0x62a8ab43u, Value(buf, sizeof(buf)));
+
+  for (int i = 0; i < 32; i++) {
+    buf[i] = i;
+  }
+  EXPECT_EQ(0x46dd794eu, Value(buf, sizeof(buf)));
+
+  for (int i = 0; i < 32; i++) {
+    buf[i] = 31 - i;
+  }
+  EXPECT_EQ(0x113fdb5cu, Value(buf, sizeof(buf)));
+  EXPECT_EQ(0xe3069283u, Value("123456789", 9));
+}
+
+TEST(CRC, Extend)
+{
+  std::string data = "hello world, this spans more than one word";
+  for (size_t split = 0; split <= data.size(); ++split) {
+    uint32_t crc = Extend(Value(data.data(), split), data.data() + split,
+                          data.size() - split);
+    EXPECT_EQ(Value(data.data(), data.size()), crc);
+    EXPECT_EQ(ExtendPortable(0, data.data(), data.size()), crc);
+  }
+}
+
+TEST(CRC, Mask)
+{
+  uint32_t crc = Value("foo", 3);
+  EXPECT_NE(crc, Mask(crc));
+  EXPECT_NE(crc, Mask(Mask(crc)));
+  EXPECT_EQ(crc, Unmask(Mask(crc)));
+  EXPECT_EQ(crc, Unmask(Unmask(Mask(Mask(crc)))));
+}
+
+}  // namespace crc32c
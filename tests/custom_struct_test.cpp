@@ -4,8 +4,10 @@
 
 #include "gtest/gtest.h"
 #include "trie.h"
+#include "schema.h"
 #include "stbe.h"
 #include "test_param.h"
+#include "test_util.h"
 
 namespace stbe {
 
@@ -52,9 +54,22 @@ public:
   }
 };
 
+// The same record with a marshaller generated from a schema.
+struct SchemaRecord {
+  std::string category;
+  uint32_t total_items;
+  std::string contact_phone;
+};
+
+template<>
+class recordMarshaller<SchemaRecord>
+    : public schemaMarshaller<SchemaRecord, &SchemaRecord::category,
+                              &SchemaRecord::total_items, &SchemaRecord::contact_phone> {};
+
 
 TEST(CustomStructTest, TestCustomStruct)
 {
+  TempFile tmp("custom_struct_test_file");
   Record test_data[] = {
     {"/food/fruit/dried_fruit", 100, "+1-408-996-9900"}, 
     {"/food/fruit/fresh", 200, "+1-408-996-9901"}, 
@@ -63,13 +78,13 @@ TEST(CustomStructTest, TestCustomStruct)
     {"/medicine/flu", 890, "+1-408-996-9904"}
   };
   Builder<Record> builder;
-  builder.initialize("custom_struct_test_file");
+  builder.initialize(tmp.path());
   for (auto& r : test_data) {
     builder.add(r);
   }
   builder.finalize();
  
-  Decoder<Record> decoder("custom_struct_test_file");
+  Decoder<Record> decoder(tmp.path());
   ASSERT_EQ(sizeof(test_data)/sizeof(Record), decoder.totalRecords())
       << "Unmatched # of records.";
   Record value;
@@ -86,4 +101,259 @@ TEST(CustomStructTest, TestCustomStruct)
   EXPECT_EQ(e, decoder[decoder.totalRecords()]) << "Too many values than expected.";
 }
 
+TEST(CustomStructTest, Scan)
+{
+  std::vector<Record> test_data;
+  for (uint32_t i = 0; i < 1000; ++i) {
+    test_data.push_back({i % 3 == 0 ? "/food/fruit/" + std::to_string(i % 7)
+                                    : "/book/" + std::to_string(i % 5),
+                         i, "+1-408-996-" + std::to_string(9900 + i % 11)});
+  }
+  Builder<Record> builder(512);
+  builder.enableChildIndex();
+  builder.initialize("custom_struct_scan_file");
+  builder.add(test_data);
+  builder.finalize();
+
+  Decoder<Record> decoder("custom_struct_scan_file");
+  ASSERT_LT(1u, decoder.file()->numBlocks());
+  std::vector<uint64_t> found;
+  // string fields are counted, total_items is not one.
+  ASSERT_TRUE(decoder.scan(1, StringPredicate::equals("+1-408-996-9903"),
+                           [&](uint64_t index, const Record& r) {
+    EXPECT_EQ(test_data[index], r);
+    found.push_back(index);
+  }));
+  std::vector<uint64_t> expected;
+  for (uint32_t i = 0; i < test_data.size(); ++i) {
+    if (i % 11 == 3) expected.push_back(i);
+  }
+  EXPECT_EQ(expected, found);
+
+  size_t food = 0;
+  ASSERT_TRUE(decoder.scan(0, StringPredicate::prefix("/food/"),
+                           [&](uint64_t index, const Record&) {
+    EXPECT_EQ(0u, index % 3);
+    ++food;
+  }));
+  EXPECT_EQ(334u, food);
+  // the cursor is still usable afterwards.
+  EXPECT_EQ(test_data[10], decoder[10]);
+}
+
+TEST(CustomStructTest, Schema)
+{
+  BlockEncoder<Record> encoder;
+  BlockEncoder<SchemaRecord> schema_encoder;
+  std::vector<Record> records;
+  for (uint32_t i = 0; i < 200; ++i) {
+    Record r{"/food/fruit/" + std::to_string(i % 9), i * 3,
+             "+1-408-996-" + std::to_string(9900 + i % 13)};
+    records.push_back(r);
+    encoder.add(r);
+    schema_encoder.add(SchemaRecord{r.category, r.total_items, r.contact_phone});
+  }
+  // the schema encodes exactly like the hand-written marshaller.
+  std::string buf = encoder.serialize();
+  EXPECT_TRUE(buf == schema_encoder.serialize());
+
+  BlockDecoder<SchemaRecord> decoder(buf);
+  SchemaRecord value;
+  for (auto& r : records) {
+    ASSERT_TRUE(decoder.nextRecord(value));
+    EXPECT_EQ(r.category, value.category);
+    EXPECT_EQ(r.total_items, value.total_items);
+    EXPECT_EQ(r.contact_phone, value.contact_phone);
+  }
+  EXPECT_FALSE(decoder.nextRecord(value));
+  ASSERT_TRUE(decoder.go(150));
+  ASSERT_TRUE(decoder.nextRecord(value));
+  EXPECT_EQ(records[150].contact_phone, value.contact_phone);
+
+  size_t matches = 0;
+  ASSERT_TRUE(decoder.go(0));
+  ASSERT_TRUE(decoder.scan(1, StringPredicate::equals("+1-408-996-9905"),
+                           [&](uint32_t i, const SchemaRecord&) {
+    EXPECT_EQ(5u, i % 13);
+    ++matches;
+  }));
+  EXPECT_EQ(15u, matches);
+
+  // 3 varints per record: category node, total_items, contact_phone node.
+  std::vector<uint32_t> raw(3 * 150);
+  ASSERT_TRUE(decoder.go(50));
+  ASSERT_TRUE(decoder.nextRecordsRaw(150, raw.data()));
+  for (uint32_t i = 0; i < 150; ++i) {
+    EXPECT_EQ(records[50 + i].total_items, raw[3 * i + 1]);
+    EXPECT_EQ(raw[3 * (i % 9)], raw[3 * i]);
+  }
+  EXPECT_FALSE(decoder.nextRecordsRaw(1, raw.data()));
+}
+
+
+TEST(CustomStructTest, Columnar)
+{
+  TempFile tmp("test_file_columnar");
+  std::vector<SchemaRecord> records;
+  for (uint32_t i = 0; i < 3000; ++i) {
+    records.push_back(SchemaRecord{"/food/fruit/" + std::to_string(i % 9), i * 3,
+                                   "+1-408-996-" + std::to_string(9900 + i % 13)});
+  }
+  Builder<SchemaRecord> builder(4096);
+  builder.enableColumnar();
+  builder.initialize(tmp.path());
+  builder.add(records);
+  builder.finalize();
+
+  Decoder<SchemaRecord> decoder(tmp.path());
+  ASSERT_EQ(records.size(), decoder.totalRecords());
+  ASSERT_LT(1u, decoder.file()->numBlocks());
+  SchemaRecord value;
+  for (auto& r : records) {
+    ASSERT_TRUE(decoder.nextRecord(value));
+    EXPECT_EQ(r.category, value.category);
+    EXPECT_EQ(r.total_items, value.total_items);
+    EXPECT_EQ(r.contact_phone, value.contact_phone);
+  }
+  EXPECT_FALSE(decoder.nextRecord(value));
+  for (uint64_t i : {2999, 5, 1000, 1001, 17}) {
+    EXPECT_EQ(records[i].contact_phone, decoder[i].contact_phone);
+  }
+
+  // only total_items, the second field.
+  decoder.setProjection({1});
+  for (uint64_t i : {2999, 5, 1000, 1001, 17}) {
+    value = decoder[i];
+    EXPECT_EQ(records[i].total_items, value.total_items);
+    EXPECT_TRUE(value.category.empty());
+    EXPECT_TRUE(value.contact_phone.empty());
+  }
+
+  size_t matches = 0;
+  ASSERT_TRUE(decoder.scan(1, StringPredicate::equals("+1-408-996-9905"),
+                           [&](uint64_t i, const SchemaRecord& r) {
+    EXPECT_EQ(5u, i % 13);
+    EXPECT_EQ(records[i].total_items, r.total_items);
+    ++matches;
+  }));
+  EXPECT_EQ(231u, matches);
+
+  FileHandle::Block block;
+  ASSERT_TRUE(decoder.file()->readDataBlock(1, &block));
+  BlockDecoder<SchemaRecord> block_decoder(block.data, block.size);
+  EXPECT_TRUE(block_decoder.isColumnar());
+  const FileHandle::BlockInfo& info = decoder.file()->blockInfo(1);
+  uint64_t base = info.accumlated_records - info.num_records;
+  std::vector<uint32_t> raw(3 * 10);
+  ASSERT_TRUE(block_decoder.go(3));
+  ASSERT_TRUE(block_decoder.nextRecordsRaw(10, raw.data()));
+  for (uint32_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(records[base + 3 + i].total_items, raw[3 * i + 1]);
+  }
+  ASSERT_TRUE(block_decoder.nextRecord(value));
+  EXPECT_EQ(records[base + 13].contact_phone, value.contact_phone);
+}
+
+TEST(CustomStructTest, FieldTries)
+{
+  TempFile tmp("test_file_field_tries");
+  std::vector<SchemaRecord> records;
+  for (uint32_t i = 0; i < 3000; ++i) {
+    records.push_back(SchemaRecord{"/food/fruit/" + std::to_string(i % 9), i * 3,
+                                   "+1-408-996-" + std::to_string(9900 + i % 13)});
+  }
+  for (bool child_index : {false, true}) {
+    Builder<SchemaRecord> builder(4096);
+    builder.enableFieldTries();
+    if (child_index) builder.enableChildIndex();
+    builder.initialize(tmp.path());
+    builder.add(records);
+    builder.finalize();
+
+    Decoder<SchemaRecord> decoder(tmp.path());
+    ASSERT_EQ(records.size(), decoder.totalRecords());
+    SchemaRecord value;
+    for (auto& r : records) {
+      ASSERT_TRUE(decoder.nextRecord(value));
+      EXPECT_EQ(r.category, value.category);
+      EXPECT_EQ(r.total_items, value.total_items);
+      EXPECT_EQ(r.contact_phone, value.contact_phone);
+    }
+    EXPECT_EQ(records[1234].contact_phone, decoder[1234].contact_phone);
+
+    size_t matches = 0;
+    ASSERT_TRUE(decoder.scan(0, StringPredicate::prefix("/food/fruit/1"),
+                             [&](uint64_t i, const SchemaRecord&) {
+      EXPECT_EQ(1u, i % 9);
+      ++matches;
+    }));
+    EXPECT_EQ(334u, matches);
+
+    FileHandle::Block block;
+    ASSERT_TRUE(decoder.file()->readDataBlock(0, &block));
+    BlockDecoder<SchemaRecord> block_decoder(block.data, block.size);
+    EXPECT_EQ(2u, block_decoder.numTries());
+    if (child_index) {
+      // phone numbers are only in the second trie.
+      std::vector<uint32_t> positions;
+      ASSERT_TRUE(block_decoder.findExact("+1-408-996-9901", &positions));
+      ASSERT_EQ(1u, positions.size());
+      ASSERT_TRUE(block_decoder.nextRecord(value));
+      ASSERT_TRUE(block_decoder.nextRecord(value));
+      EXPECT_EQ("+1-408-996-9901", value.contact_phone);
+    }
+  }
+}
+
+TEST(CustomStructTest, Streaming)
+{
+  TempFile tmp("test_file_streaming");
+  std::vector<SchemaRecord> records;
+  for (uint32_t i = 0; i < 500; ++i) {
+    records.push_back(SchemaRecord{"/food/fruit/" + std::to_string(i % 9), i * 3,
+                                   "+1-408-996-" + std::to_string(9900 + i % 13)});
+  }
+  auto dictionary = std::make_shared<const Dictionary>(
+      std::vector<std::string>{"/food/fruit/1", "/food/fruit/2"});
+  for (int options = 0; options < 16; ++options) {
+    BlockEncoder<SchemaRecord> encoder;
+    BlockEncoder<SchemaRecord> streaming;
+    streaming.setStreaming(true);
+    for (auto* e : {&encoder, &streaming}) {
+      e->setChildIndex(options & 1);
+      e->setColumnar(options & 2);
+      e->setFieldTries(options & 4);
+      if (options & 8) e->setDictionary(dictionary);
+    }
+    // twice, the second block reuses the encoders.
+    for (int block = 0; block < 2; ++block) {
+      for (size_t i = block; i < records.size(); i += 2) {
+        encoder.add(records[i]);
+        streaming.add(records[i]);
+      }
+      EXPECT_EQ(encoder.numRecords(), streaming.numRecords());
+      EXPECT_EQ(encoder.estimatedSize(), streaming.estimatedSize());
+      EXPECT_TRUE(encoder.serialize() == streaming.serialize()) << options << " " << block;
+      encoder.clear();
+      streaming.clear();
+    }
+  }
+
+  Builder<SchemaRecord> builder(1024);
+  builder.enableParallelEncoding(2, 2);
+  builder.enableStreaming();
+  builder.initialize(tmp.path());
+  builder.add(records);
+  builder.finalize();
+  Decoder<SchemaRecord> decoder(tmp.path());
+  ASSERT_EQ(records.size(), decoder.totalRecords());
+  SchemaRecord value;
+  for (auto& r : records) {
+    ASSERT_TRUE(decoder.nextRecord(value));
+    EXPECT_EQ(r.category, value.category);
+    EXPECT_EQ(r.total_items, value.total_items);
+    EXPECT_EQ(r.contact_phone, value.contact_phone);
+  }
+}
+
 }  // namespace stbe
@@ -1,6 +1,8 @@
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <memory>
+#include <set>
 #include <vector>
 #include <string>
 
@@ -43,6 +45,205 @@ TEST_P(TrieTest, Decode)
   EXPECT_FALSE(decoder.nextRecord(value)) << "Too many values than expected.";
 }
 
+TEST_P(TrieTest, DecodeStringView)
+{
+  const TestParam& t = GetParam();
+  BlockEncoder<std::string> encoder;
+  for (auto& v : t.input) {
+    encoder.add(v);
+  }
+  std::string buf = encoder.serialize();
+
+  BlockDecoder<std::string> decoder(buf);
+  std::string scratch;
+  std::string_view value;
+  for (auto& ori_value : t.input) {
+    ASSERT_TRUE(decoder.decodeStringView(scratch, value));
+    EXPECT_EQ(ori_value, value);
+  }
+  EXPECT_FALSE(decoder.decodeStringView(scratch, value));
+}
+
+TEST_P(TrieTest, DecodeWithMemo)
+{
+  const TestParam& t = GetParam();
+  BlockEncoder<std::string> encoder;
+  for (auto& v : t.input) {
+    encoder.add(v);
+  }
+  std::string buf = encoder.serialize();
+
+  BlockDecoder<std::string> decoder;
+  decoder.setMemo(true);
+  // reset() drops the memo, so both passes miss once per distinct value.
+  for (int pass = 0; pass < 2; ++pass) {
+    ASSERT_TRUE(decoder.reset(buf.data(), buf.size()));
+    std::string value;
+    for (auto& ori_value : t.input) {
+      ASSERT_TRUE(decoder.nextRecord(value)) << "Unexpected end of values.";
+      EXPECT_EQ(ori_value, value);
+    }
+    EXPECT_FALSE(decoder.nextRecord(value)) << "Too many values than expected.";
+  }
+  size_t distinct = std::set<std::string>(t.input.begin(), t.input.end()).size();
+  EXPECT_EQ(2 * distinct, decoder.memoStats().misses);
+  EXPECT_EQ(2 * (t.input.size() - distinct), decoder.memoStats().hits);
+}
+
+TEST_P(TrieTest, Go)
+{
+  const TestParam& t = GetParam();
+  for (uint32_t restart_interval : {0, 1, 3, 16}) {
+    BlockEncoder<std::string> encoder(restart_interval);
+    for (auto& v : t.input) {
+      encoder.add(v);
+    }
+    std::string buf = encoder.serialize();
+
+    BlockDecoder<std::string> decoder(buf);
+    std::string value;
+    // backwards forces rewinds, forwards moves on from the last record.
+    for (size_t i = t.input.size(); i-- > 0; ) {
+      ASSERT_TRUE(decoder.go(i)) << restart_interval;
+      ASSERT_TRUE(decoder.nextRecord(value)) << restart_interval;
+      EXPECT_EQ(t.input[i], value) << restart_interval;
+    }
+    for (size_t i = 0; i < t.input.size(); i += 2) {
+      ASSERT_TRUE(decoder.go(i)) << restart_interval;
+      ASSERT_TRUE(decoder.nextRecord(value)) << restart_interval;
+      EXPECT_EQ(t.input[i], value) << restart_interval;
+    }
+    EXPECT_FALSE(decoder.go(t.input.size() + 1)) << restart_interval;
+  }
+}
+
+TEST_P(TrieTest, FindByValue)
+{
+  const TestParam& t = GetParam();
+  BlockEncoder<std::string> encoder;
+  encoder.setChildIndex(true);
+  for (auto& v : t.input) {
+    encoder.add(v);
+  }
+  std::string buf = encoder.serialize();
+
+  BlockDecoder<std::string> decoder(buf);
+  ASSERT_TRUE(decoder.hasChildIndex());
+  std::string value;
+  for (auto& ori_value : t.input) {
+    ASSERT_TRUE(decoder.nextRecord(value));
+    EXPECT_EQ(ori_value, value);
+  }
+  // node positions of the records, the whole record of a string.
+  BlockDecoder<std::string> pos_decoder(buf);
+  std::vector<uint32_t> record_pos(t.input.size());
+  for (size_t i = 0; i < t.input.size(); ++i) {
+    ASSERT_TRUE(pos_decoder.decodeUint32(record_pos[i]));
+  }
+
+  for (size_t i = 0; i < t.input.size(); ++i) {
+    std::vector<uint32_t> positions;
+    ASSERT_TRUE(decoder.findExact(t.input[i], &positions));
+    for (size_t j = 0; j < t.input.size(); ++j) {
+      bool found = std::find(positions.begin(), positions.end(), record_pos[j]) !=
+          positions.end();
+      EXPECT_EQ(t.input[i] == t.input[j], found) << i << " " << j;
+    }
+
+    for (size_t len = 0; len <= t.input[i].size(); ++len) {
+      std::string prefix = t.input[i].substr(0, len);
+      std::vector<std::pair<uint32_t, uint32_t>> ranges;
+      ASSERT_TRUE(decoder.findPrefix(prefix, &ranges));
+      for (size_t j = 0; j < t.input.size(); ++j) {
+        bool found = false;
+        for (auto& r : ranges) {
+          found |= record_pos[j] >= r.first && record_pos[j] < r.second;
+        }
+        EXPECT_EQ(t.input[j].compare(0, len, prefix) == 0, found)
+            << prefix << " " << t.input[j];
+      }
+    }
+  }
+
+  std::vector<uint32_t> positions;
+  ASSERT_TRUE(decoder.findExact("/not/there", &positions));
+  EXPECT_TRUE(positions.empty());
+
+  BlockEncoder<std::string> plain;
+  plain.add("abc");
+  BlockDecoder<std::string> plain_decoder(plain.serialize());
+  EXPECT_FALSE(plain_decoder.findExact("abc", &positions));
+}
+
+TEST_P(TrieTest, Scan)
+{
+  const TestParam& t = GetParam();
+  for (bool child_index : {false, true}) {
+    BlockEncoder<std::string> encoder;
+    encoder.setChildIndex(child_index);
+    for (auto& v : t.input) {
+      encoder.add(v);
+    }
+    std::string buf = encoder.serialize();
+    BlockDecoder<std::string> decoder(buf);
+
+    std::vector<StringPredicate> predicates{StringPredicate::prefix(""),
+                                            StringPredicate::equals("/not/there")};
+    for (auto& v : t.input) {
+      predicates.push_back(StringPredicate::equals(v));
+      predicates.push_back(StringPredicate::prefix(v.substr(0, v.size() / 2)));
+    }
+    for (auto& predicate : predicates) {
+      ASSERT_TRUE(decoder.go(0));
+      std::vector<std::pair<uint32_t, std::string>> found;
+      ASSERT_TRUE(decoder.scan(0, predicate, [&](uint32_t i, const std::string& v) {
+        found.emplace_back(i, v);
+      }));
+      std::vector<std::pair<uint32_t, std::string>> expected;
+      for (uint32_t i = 0; i < t.input.size(); ++i) {
+        if (predicate.matches(t.input[i])) expected.emplace_back(i, t.input[i]);
+      }
+      EXPECT_EQ(expected, found) << child_index << " " << predicate.operand;
+    }
+    // there is a single string field.
+    ASSERT_TRUE(decoder.go(0));
+    size_t calls = 0;
+    ASSERT_TRUE(decoder.scan(1, StringPredicate::prefix(""),
+                             [&](uint32_t, const std::string&) { ++calls; }));
+    EXPECT_EQ(0u, calls);
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(Trie, TrieTest, ::testing::ValuesIn(tests));
 
+TEST(DecodeTest, DeepTrie)
+{
+  // Every value extends the previous one by a new node, building a parent
+  // chain deeper than the decoder's fixed piece stack.
+  std::vector<std::string> input;
+  std::string value;
+  for (char c = 'a'; c <= 'z'; ++c) {
+    value.append(2, c);
+    input.push_back(value);
+    value.append(2, c - 'a' + 'A');
+    input.push_back(value);
+  }
+  BlockEncoder<std::string> encoder;
+  for (auto& v : input) {
+    encoder.add(v);
+  }
+  std::string buf = encoder.serialize();
+
+  BlockDecoder<std::string> decoder(buf);
+  std::string scratch;
+  std::string_view view;
+  for (auto& ori_value : input) {
+    ASSERT_TRUE(decoder.decodeStringView(scratch, view));
+    EXPECT_EQ(ori_value, view);
+  }
+  ASSERT_TRUE(decoder.go(input.size() - 1));
+  ASSERT_TRUE(decoder.nextRecord(value));
+  EXPECT_EQ(input.back(), value);
+}
+
 }  // namespace stbe
@@ -1,11 +1,15 @@
 #include <iostream>
 #include <memory>
+#include <random>
+#include <thread>
 #include <vector>
 
 #include "gtest/gtest.h"
 #include "trie.h"
+#include "scanner.h"
 #include "stbe.h"
 #include "test_param.h"
+#include "test_util.h"
 
 namespace stbe {
 
@@ -15,13 +19,14 @@ class STBETest : public ::testing::TestWithParam<TestParam> {
 
 TEST_P(STBETest, Decode)
 {
+  TempFile tmp("test_file");
   const TestParam& t = GetParam();
   Builder<std::string> builder;
-  builder.initialize("test_file");
+  builder.initialize(tmp.path());
   builder.add(t.input);
   builder.finalize();
  
-  Decoder<std::string> decoder("test_file");
+  Decoder<std::string> decoder(tmp.path());
   ASSERT_EQ(t.input.size(), decoder.totalRecords())
       << "Unmatched # of records.";
   std::string value;
@@ -38,6 +43,535 @@ TEST_P(STBETest, Decode)
   EXPECT_EQ("", decoder[decoder.totalRecords()]) << "Too many values than expected.";
 }
 
+TEST_P(STBETest, DecodeMmap)
+{
+  TempFile tmp("test_file_mmap");
+  const TestParam& t = GetParam();
+  Builder<std::string> builder(16);
+  builder.initialize(tmp.path());
+  builder.add(t.input);
+  builder.finalize();
+
+  DecoderOptions options;
+  options.use_mmap = true;
+  options.mmap.advice = MmapFile::kRandom;
+  Decoder<std::string> decoder(tmp.path(), options);
+  ASSERT_EQ(t.input.size(), decoder.totalRecords())
+      << "Unmatched # of records.";
+  std::string value;
+  for (auto& ori_value : t.input) {
+    ASSERT_TRUE(decoder.nextRecord(value)) << "Unexpected end of values.";
+    EXPECT_EQ(ori_value, value);
+  }
+  EXPECT_FALSE(decoder.nextRecord(value)) << "Too many values than expected.";
+
+  for (uint32_t i = t.input.size(); i-- > 0; ) {
+    EXPECT_EQ(t.input[i], decoder[i]);
+  }
+  EXPECT_EQ("", decoder[decoder.totalRecords()]) << "Too many values than expected.";
+}
+
+TEST_P(STBETest, DecodeSmallBlocks)
+{
+  // A tiny block size spreads the values over many blocks, so the encoder
+  // is cleared and reused between them.
+  TempFile tmp("test_file_small_blocks");
+  const TestParam& t = GetParam();
+  Builder<std::string> builder(16);
+  builder.initialize(tmp.path());
+  builder.add(t.input);
+  builder.finalize();
+
+  Decoder<std::string> decoder(tmp.path());
+  ASSERT_EQ(t.input.size(), decoder.totalRecords())
+      << "Unmatched # of records.";
+  std::string value;
+  for (auto& ori_value : t.input) {
+    ASSERT_TRUE(decoder.nextRecord(value)) << "Unexpected end of values.";
+    EXPECT_EQ(ori_value, value);
+  }
+  EXPECT_FALSE(decoder.nextRecord(value)) << "Too many values than expected.";
+
+  for (uint32_t i = 0 ; i < decoder.totalRecords(); ++i) {
+    EXPECT_EQ(t.input[i], decoder[i]);
+  }
+}
+
+TEST_P(STBETest, DecodeCompressed)
+{
+  TempFile tmp("test_file_compressed");
+  const TestParam& t = GetParam();
+  for (bool use_mmap : {false, true}) {
+    Builder<std::string> builder(1);  // a block per record
+    ASSERT_TRUE(builder.setCompression(kLZCompression));
+    builder.initialize(tmp.path());
+    builder.add(t.input);
+    builder.finalize();
+
+    DecoderOptions options;
+    options.use_mmap = use_mmap;
+    options.verify_checksums = kVerifyAlways;
+    Decoder<std::string> decoder(tmp.path(), options);
+    ASSERT_EQ(t.input.size(), decoder.totalRecords())
+        << "Unmatched # of records.";
+    std::string value;
+    for (auto& ori_value : t.input) {
+      ASSERT_TRUE(decoder.nextRecord(value)) << "Unexpected end of values.";
+      EXPECT_EQ(ori_value, value);
+    }
+    for (uint32_t i = t.input.size(); i-- > 0; ) {
+      EXPECT_EQ(t.input[i], decoder[i]);
+    }
+  }
+}
+
 INSTANTIATE_TEST_SUITE_P(stbe, STBETest, ::testing::ValuesIn(tests));
 
+TEST_P(STBETest, DecodeFormatV1)
+{
+  // Lay out a version 1 file by hand: one data block, an index block with
+  // varint32 offsets and the Fixed32 index block offset at the end.
+  TempFile tmp("test_file_v1");
+  const TestParam& t = GetParam();
+  BlockEncoder<std::string> encoder;
+  for (auto& v : t.input) {
+    encoder.add(v);
+  }
+  std::string file;
+  std::string index;
+  PutVarint32(&index, t.input.empty() ? 0 : 1);
+  if (!t.input.empty()) {
+    PutVarint32Varint32(&index, 0, t.input.size());
+    const std::string& block = encoder.serialize();
+    PutFixed32(&file, block.size());
+    file.append(block);
+  }
+  uint32_t index_block_offset = file.size();
+  PutFixed32(&file, index.size());
+  file.append(index);
+  PutFixed32(&file, index_block_offset);
+  std::ofstream(tmp.path(), std::ofstream::binary) << file;
+
+  for (bool use_mmap : {false, true}) {
+    DecoderOptions options;
+    options.use_mmap = use_mmap;
+    Decoder<std::string> decoder(tmp.path(), options);
+    EXPECT_EQ(kFormatVersion1, decoder.file()->formatVersion());
+    ASSERT_EQ(t.input.size(), decoder.totalRecords())
+        << "Unmatched # of records.";
+    for (uint32_t i = 0 ; i < decoder.totalRecords(); ++i) {
+      EXPECT_EQ(t.input[i], decoder[i]);
+    }
+  }
+}
+
+TEST(BuilderTest, ParallelEncodingIsIdentical)
+{
+  TempFile tmp_serial("test_file_serial");
+  TempFile tmp_parallel("test_file_parallel");
+  std::vector<std::string> input;
+  for (int i = 0; i < 5000; ++i) {
+    input.push_back("/history/apollo/apollo-" + std::to_string(i % 17) + "/" +
+                    std::to_string(i * 31));
+  }
+  Builder<std::string> serial(512);
+  serial.initialize(tmp_serial.path());
+  serial.add(input);
+  serial.finalize();
+
+  for (uint32_t max_inflight_blocks : {1, 2, 8}) {
+    Builder<std::string> parallel(512);
+    parallel.enableParallelEncoding(4, max_inflight_blocks);
+    parallel.initialize(tmp_parallel.path());
+    parallel.add(input);
+    parallel.finalize();
+
+    std::ifstream f1(tmp_serial.path(), std::ifstream::binary);
+    std::ifstream f2(tmp_parallel.path(), std::ifstream::binary);
+    std::string s1((std::istreambuf_iterator<char>(f1)), std::istreambuf_iterator<char>());
+    std::string s2((std::istreambuf_iterator<char>(f2)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(s1.size(), s2.size()) << max_inflight_blocks;
+    EXPECT_TRUE(s1 == s2) << max_inflight_blocks;
+  }
+  Decoder<std::string> decoder(tmp_parallel.path());
+  EXPECT_EQ(kLatestFormatVersion, decoder.file()->formatVersion());
+  ASSERT_EQ(input.size(), decoder.totalRecords());
+  EXPECT_EQ(input[4321], decoder[4321]);
+}
+
+TEST(BuilderTest, RejectsTriesTooLargeForBlock)
+{
+  TempFile tmp("test_file_large");
+  // a value alone is enough to push the records offset into the block flags.
+  std::vector<std::string> input{"small", std::string(kMaxRecordsOffset, 'x'), "small"};
+  for (uint32_t num_threads : {0, 2}) {
+    Builder<std::string> builder(1);  // a block per record
+    builder.enableParallelEncoding(num_threads, 2);
+    builder.initialize(tmp.path());
+    builder.add(input);
+    EXPECT_FALSE(builder.finalize()) << num_threads;
+
+    Decoder<std::string> decoder(tmp.path());
+    ASSERT_EQ(2u, decoder.totalRecords()) << num_threads;
+    EXPECT_EQ("small", decoder[1]) << num_threads;
+  }
+}
+
+TEST(BuilderTest, CompressionShrinksFile)
+{
+  TempFile tmp_raw("test_file_raw");
+  TempFile tmp_lz("test_file_lz");
+  std::vector<std::string> input;
+  for (int i = 0; i < 20000; ++i) {
+    input.push_back("/shuttle/missions/sts-" + std::to_string(i % 71) +
+                    "/images/KSC-94EC-" + std::to_string(i % 13) + ".jpg");
+  }
+  Builder<std::string> raw(16 * 1024);
+  raw.initialize(tmp_raw.path());
+  raw.add(input);
+  raw.finalize();
+
+  auto cache = std::make_shared<BlockCache>(1 << 20);
+  for (uint32_t num_threads : {0, 3}) {
+    Builder<std::string> compressed(16 * 1024);
+    EXPECT_FALSE(compressed.setCompression(kFirstUserCodec + 1));
+    ASSERT_TRUE(compressed.setCompression(kLZCompression));
+    compressed.enableParallelEncoding(num_threads, 4);
+    compressed.initialize(tmp_lz.path());
+    compressed.add(input);
+    compressed.finalize();
+
+    std::ifstream f1(tmp_raw.path(), std::ifstream::binary | std::ifstream::ate);
+    std::ifstream f2(tmp_lz.path(), std::ifstream::binary | std::ifstream::ate);
+    EXPECT_LT(f2.tellg(), f1.tellg()) << num_threads;
+
+    DecoderOptions options;
+    options.block_cache = cache;
+    Decoder<std::string> decoder(tmp_lz.path(), options);
+    ASSERT_EQ(input.size(), decoder.totalRecords());
+    for (size_t i = 0; i < input.size(); i += 97) {
+      EXPECT_EQ(input[i], decoder[i]);
+    }
+  }
+}
+
+TEST(BuilderTest, Dictionary)
+{
+  TempFile tmp_plain("test_file_plain");
+  TempFile tmp_dictionary("test_file_dictionary");
+  // hosts repeat across all blocks, request ids do not.
+  std::vector<std::string> input;
+  for (int i = 0; i < 20000; ++i) {
+    input.push_back(i % 4 == 0 ? "req-" + std::to_string(i)
+                               : "host-" + std::to_string(i % 301) + ".example.com");
+  }
+  Builder<std::string> plain(4096);
+  plain.initialize(tmp_plain.path());
+  plain.add(input);
+  plain.finalize();
+
+  for (uint32_t num_threads : {0, 2}) {
+    Builder<std::string> builder(4096);
+    builder.enableParallelEncoding(num_threads, 2);
+    builder.enableChildIndex();
+    builder.setDictionary(std::vector<std::string>(input.begin(), input.begin() + 2000));
+    builder.initialize(tmp_dictionary.path());
+    builder.add(input);
+    builder.finalize();
+
+    std::ifstream f1(tmp_plain.path(), std::ifstream::binary | std::ifstream::ate);
+    std::ifstream f2(tmp_dictionary.path(), std::ifstream::binary | std::ifstream::ate);
+    EXPECT_LT(f2.tellg(), f1.tellg()) << num_threads;
+
+    for (bool use_mmap : {false, true}) {
+      DecoderOptions options;
+      options.use_mmap = use_mmap;
+      Decoder<std::string> decoder(tmp_dictionary.path(), options);
+      EXPECT_FALSE(decoder.file()->dictionary().empty());
+      ASSERT_EQ(input.size(), decoder.totalRecords());
+      std::string value;
+      for (auto& s : input) {
+        ASSERT_TRUE(decoder.nextRecord(value));
+        EXPECT_EQ(s, value);
+      }
+      EXPECT_EQ(input[4321], decoder[4321]);
+
+      size_t matches = 0;
+      ASSERT_TRUE(decoder.scan(0, StringPredicate::equals("host-7.example.com"),
+                               [&](uint64_t i, const std::string& r) {
+        EXPECT_EQ(input[i], r);
+        ++matches;
+      }));
+      EXPECT_EQ(50u, matches);
+    }
+  }
+}
+
+TEST(BuilderTest, ChildIndex)
+{
+  TempFile tmp("test_file_child_index");
+  std::vector<std::string> input;
+  for (int i = 0; i < 2000; ++i) {
+    input.push_back("/elv/DELTA/delta-" + std::to_string(i % 19) + ".gif");
+  }
+  Builder<std::string> builder(1024);
+  builder.enableParallelEncoding(2, 2);
+  builder.enableChildIndex();
+  builder.initialize(tmp.path());
+  builder.add(input);
+  builder.finalize();
+
+  Decoder<std::string> decoder(tmp.path());
+  ASSERT_EQ(input.size(), decoder.totalRecords());
+  ASSERT_LT(1u, decoder.file()->numBlocks());
+  for (size_t i = 0; i < input.size(); i += 7) {
+    EXPECT_EQ(input[i], decoder[i]);
+  }
+  for (uint32_t b = 0; b < decoder.file()->numBlocks(); ++b) {
+    FileHandle::Block block;
+    ASSERT_TRUE(decoder.file()->readDataBlock(b, &block));
+    BlockDecoder<std::string> block_decoder(block.data, block.size);
+    EXPECT_TRUE(block_decoder.hasChildIndex()) << b;
+    std::vector<uint32_t> positions;
+    EXPECT_TRUE(block_decoder.findExact("/elv/DELTA/delta-3.gif", &positions));
+    EXPECT_EQ(1u, positions.size()) << b;
+  }
+}
+
+TEST(BuilderTest, FieldSummaries)
+{
+  TempFile tmp("test_file_summaries");
+  // paths arrive roughly sorted, as in a log, so blocks cover narrow ranges.
+  std::vector<std::string> input;
+  for (int i = 0; i < 5000; ++i) {
+    input.push_back("/logs/day-" + std::to_string(1000 + i / 50) + "/req-" +
+                    std::to_string(i % 37));
+  }
+  for (uint32_t num_threads : {0, 2}) {
+    Builder<std::string> builder(1024);
+    builder.enableParallelEncoding(num_threads, 2);
+    builder.enableFieldSummaries();
+    builder.initialize(tmp.path());
+    builder.add(input);
+    builder.finalize();
+
+    Decoder<std::string> decoder(tmp.path());
+    const FileHandle& file = *decoder.file();
+    ASSERT_LT(10u, file.numBlocks());
+    FileHandle::FieldSummary summary;
+    ASSERT_TRUE(file.fieldSummary(0, 0, &summary));
+    EXPECT_EQ(input[0], summary.min);
+    EXPECT_FALSE(summary.filter.empty());
+    EXPECT_FALSE(file.fieldSummary(0, 1, &summary));
+
+    for (auto& predicate : {StringPredicate::equals(input[2345]),
+                            StringPredicate::equals("/logs/day-1046/req-99"),
+                            StringPredicate::prefix("/logs/day-1046/"),
+                            StringPredicate::prefix("/logs/day-2")}) {
+      uint32_t candidates = 0;
+      for (uint32_t b = 0; b < file.numBlocks(); ++b) {
+        candidates += file.blockMayMatch(b, 0, predicate);
+      }
+      EXPECT_GE(3u, candidates) << predicate.operand;
+
+      std::vector<uint64_t> found;
+      ASSERT_TRUE(decoder.scan(0, predicate, [&](uint64_t i, const std::string&) {
+        found.push_back(i);
+      }));
+      std::vector<uint64_t> expected;
+      for (uint64_t i = 0; i < input.size(); ++i) {
+        if (predicate.matches(input[i])) expected.push_back(i);
+      }
+      EXPECT_EQ(expected, found) << predicate.operand;
+    }
+  }
+
+  // without summaries every block may match.
+  Builder<std::string> builder(1024);
+  builder.initialize(tmp.path());
+  builder.add(input);
+  builder.finalize();
+  FileHandle file(tmp.path());
+  EXPECT_TRUE(file.blockMayMatch(0, 0, StringPredicate::equals("/none")));
+}
+
+TEST(CursorTest, MultiGet)
+{
+  TempFile tmp("test_file_multiget");
+  std::vector<std::string> input;
+  for (int i = 0; i < 3000; ++i) {
+    input.push_back("/history/skylab/skylab-" + std::to_string(i % 23) + "/" +
+                    std::to_string(i * 7));
+  }
+  Builder<std::string> builder(1024);
+  builder.initialize(tmp.path());
+  builder.add(input);
+  builder.finalize();
+
+  Decoder<std::string> decoder(tmp.path());
+  ASSERT_LT(1u, decoder.file()->numBlocks());
+  std::mt19937 rnd(17);
+  std::vector<uint64_t> indices;
+  for (int i = 0; i < 2000; ++i) {
+    indices.push_back(rnd() % (input.size() + 10));  // some out of range
+  }
+  indices.push_back(indices[0]);  // and some duplicates
+  indices.push_back(indices[1]);
+  std::vector<std::string> values;
+  decoder.multiGet(indices, &values);
+  ASSERT_EQ(indices.size(), values.size());
+  for (size_t i = 0; i < indices.size(); ++i) {
+    EXPECT_EQ(indices[i] < input.size() ? input[indices[i]] : "", values[i]) << i;
+  }
+
+  decoder.multiGet(std::vector<uint64_t>(), &values);
+  EXPECT_TRUE(values.empty());
+}
+
+TEST(ScannerTest, ScanAndSeek)
+{
+  TempFile tmp("test_file_scanner");
+  std::vector<std::string> input;
+  for (int i = 0; i < 3000; ++i) {
+    input.push_back("/software/winvn/winvn-" + std::to_string(i % 31) + "/" +
+                    std::to_string(i * 3));
+  }
+  Builder<std::string> builder(512);
+  builder.initialize(tmp.path());
+  builder.add(input);
+  builder.finalize();
+
+  for (bool use_mmap : {false, true}) {
+    DecoderOptions options;
+    options.use_mmap = use_mmap;
+    auto file = std::make_shared<const FileHandle>(tmp.path(), options);
+    ASSERT_LT(4u, file->numBlocks());
+    for (uint32_t depth : {0, 1, 4}) {
+      Scanner<std::string> scanner(file, depth);
+      size_t i = 0;
+      for (const std::string& value : scanner) {
+        ASSERT_LT(i, input.size());
+        EXPECT_EQ(input[i], value) << i;
+        ++i;
+      }
+      EXPECT_EQ(input.size(), i) << use_mmap << depth;
+      EXPECT_FALSE(scanner.valid());
+
+      // jump around, back and forth across blocks, and forward within the
+      // blocks read ahead.
+      for (uint64_t start : {1500, 1850, 10, 2999, 700, 701, 0}) {
+        scanner.seek(start);
+        for (uint64_t j = start; j < std::min<uint64_t>(start + 300, input.size()); ++j) {
+          ASSERT_TRUE(scanner.valid()) << j;
+          EXPECT_EQ(j, scanner.index());
+          EXPECT_EQ(input[j], scanner.value());
+          scanner.next();
+        }
+      }
+      scanner.seek(input.size());
+      EXPECT_FALSE(scanner.valid());
+      EXPECT_TRUE(scanner.begin() == scanner.end());
+    }
+  }
+}
+
+TEST(CursorTest, ConcurrentCursors)
+{
+  TempFile tmp("test_file_cursors");
+  std::vector<std::string> input;
+  for (int i = 0; i < 2000; ++i) {
+    input.push_back("/shuttle/missions/sts-" + std::to_string(i % 97) + "/" +
+                    std::to_string(i));
+  }
+  Builder<std::string> builder(1024);
+  builder.initialize(tmp.path());
+  builder.add(input);
+  builder.finalize();
+
+  for (bool use_mmap : {false, true}) {
+    DecoderOptions options;
+    options.use_mmap = use_mmap;
+    auto file = std::make_shared<const FileHandle>(tmp.path(), options);
+    ASSERT_EQ(input.size(), file->totalRecords());
+    std::vector<std::thread> threads;
+    std::vector<int> mismatches(4);
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&, t] {
+        Cursor<std::string> cursor(file);
+        // each thread strides through the file in a different order.
+        for (size_t i = 0; i < input.size(); ++i) {
+          size_t index = (i * (2 * t + 7)) % input.size();
+          if (cursor[index] != input[index]) ++mismatches[t];
+        }
+      });
+    }
+    for (auto& thread : threads) thread.join();
+    for (int m : mismatches) EXPECT_EQ(0, m) << use_mmap;
+  }
+}
+
+TEST(ChecksumTest, DetectsCorruptBlock)
+{
+  TempFile tmp("test_file_checksum");
+  std::vector<std::string> input;
+  for (int i = 0; i < 500; ++i) {
+    input.push_back("/images/ksclogo-" + std::to_string(i % 13) + ".gif?" +
+                    std::to_string(i));
+  }
+  Builder<std::string> builder(512);
+  builder.initialize(tmp.path());
+  builder.add(input);
+  builder.finalize();
+
+  uint64_t offset;
+  {
+    auto file = std::make_shared<const FileHandle>(tmp.path(), DecoderOptions());
+    ASSERT_LT(2u, file->numBlocks());
+    offset = file->blockInfo(1).offset;
+  }
+  // flip a byte in the records of the second block.
+  {
+    std::fstream f(tmp.path(),
+                   std::ios::in | std::ios::out | std::ios::binary);
+    f.seekg(offset + blockHeaderSize(kLatestFormatVersion) + 8);
+    char c = f.get();
+    f.seekp(offset + blockHeaderSize(kLatestFormatVersion) + 8);
+    f.put(c ^ 0x10);
+  }
+  const uint32_t last = input.size() - 1;
+
+  for (bool use_mmap : {false, true}) {
+    for (ChecksumPolicy policy : {kVerifyAlways, kVerifyOnFirstLoad}) {
+      DecoderOptions options;
+      options.use_mmap = use_mmap;
+      options.verify_checksums = policy;
+      auto file = std::make_shared<const FileHandle>(tmp.path(), options);
+      ASSERT_EQ(input.size(), file->totalRecords());
+      Cursor<std::string> cursor(file);
+      EXPECT_EQ(input[0], cursor[0]);
+      uint64_t in_block = file->blockInfo(0).accumlated_records;
+      EXPECT_EQ("", cursor[in_block]) << use_mmap << policy;
+      EXPECT_EQ(input[last], cursor[last]);
+    }
+    DecoderOptions options;
+    options.use_mmap = use_mmap;
+    options.verify_checksums = kVerifyNever;
+    auto file = std::make_shared<const FileHandle>(tmp.path(), options);
+    FileHandle::Block block;
+    EXPECT_TRUE(file->readDataBlock(1, &block));
+  }
+
+  // a block verified once is verified again when read from the file anew.
+  auto file = std::make_shared<const FileHandle>(tmp.path(), DecoderOptions());
+  FileHandle::Block block;
+  ASSERT_TRUE(file->readDataBlock(0, &block));
+  {
+    std::fstream f(tmp.path(),
+                   std::ios::in | std::ios::out | std::ios::binary);
+    f.seekp(blockHeaderSize(kLatestFormatVersion) + 8);
+    f.put(block.data[8] ^ 0x10);
+  }
+  EXPECT_FALSE(file->readDataBlock(0, &block));
+}
+
 }  // namespace stbe
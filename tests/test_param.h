@@ -72,6 +72,21 @@ TestParam tests[] = {
     2: bc
       3: c
   1: 
+)"
+    },
+    { {"abc", "akk", "a", "", "abd", "ax", "bcd", "b", "akz"},  // siblings sharing first byte
+      R"(0: 
+  1: ab
+    2: c
+    2: d
+  1: ak
+    2: k
+    2: z
+  1: a
+    2: x
+  1: 
+    2: bcd
+    2: b
 )"
     },
    { {"128.217.62.224", "128.217.62.24", "128.217.62.2"},
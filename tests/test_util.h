@@ -0,0 +1,34 @@
+// Test utilities
+//
+#pragma once
+
+#include <unistd.h>
+#include <cstdio>
+#include <string>
+
+#include "gtest/gtest.h"
+
+namespace stbe {
+
+// A file under the test temp directory, removed when it goes out of scope.
+// The pid keeps concurrent runs of a test from sharing it.
+class TempFile {
+public:
+  explicit TempFile(const std::string& name)
+      : path_(::testing::TempDir() + name + "." + std::to_string(getpid())) {}
+  ~TempFile() {
+    std::remove(path_.c_str());
+  }
+
+  TempFile(const TempFile&) = delete;
+  void operator=(const TempFile&) = delete;
+
+  const std::string& path() const {
+    return path_;
+  }
+
+private:
+  std::string path_;
+};
+
+}  // namespace stbe